@@ -42,6 +42,33 @@ namespace YoloV5Torch
         public int Height;
     }
 
+    /// <summary>
+    /// Pixel format of image memory passed to the prediction
+    /// </summary>
+    public enum YoloPixelFormat
+    {
+        /// <summary>
+        /// 3 bytes per pixel, blue first
+        /// </summary>
+        BGR = 0,
+        /// <summary>
+        /// 3 bytes per pixel, red first
+        /// </summary>
+        RGB = 1,
+        /// <summary>
+        /// 4 bytes per pixel, blue first
+        /// </summary>
+        BGRA = 2,
+        /// <summary>
+        /// 1 byte per pixel
+        /// </summary>
+        GRAY = 3,
+        /// <summary>
+        /// Y plane followed by the interleaved UV plane, both with the same stride
+        /// </summary>
+        NV12 = 4
+    }
+
     /// <summary>
     /// Yolo V5 detection Class
     /// </summary>
@@ -70,15 +97,69 @@ namespace YoloV5Torch
         private static extern IntPtr YoloV5New(byte[] torchScriptArr, int torchScriptLength,
             bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres);
 
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5NewByPathCached", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5NewCached([MarshalAs(UnmanagedType.LPStr)] string torchscriptPath, [MarshalAs(UnmanagedType.LPStr)] string cacheDirectory,
+            bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5ColdStartMs", CallingConvention = CallingConvention.Cdecl)]
+        private static extern double YoloV5ColdStartMs(IntPtr yolov5);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5EnableChannelsLast", CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool YoloV5EnableChannelsLast(IntPtr yolov5);
+
         [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5Delete", CallingConvention = CallingConvention.Cdecl)]
         private static extern void YoloV5Delete(IntPtr yolov5);
 
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5SetFilter", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void YoloV5SetFilter(IntPtr yolov5, int[] classes, int classesLength,
+            int[] thresClasses, float[] thresValues, int thresLength, bool agnostic, int maxCandidates, int maxDetections);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5EnableCache", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void YoloV5EnableCache(IntPtr yolov5, long byteBudget);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5CacheStats", CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool YoloV5CacheStats(IntPtr yolov5, out long hits, out long misses, out long evictions, out long bytes);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5SetMemoryBudget", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void YoloV5SetMemoryBudget(IntPtr yolov5, long byteBudget);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5MemoryStats", CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool YoloV5MemoryStats(IntPtr yolov5, out long weights, out long input, out long scratch,
+            out long candidates, out long current, out long peak, out long budget);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5EstimateMemory", CallingConvention = CallingConvention.Cdecl)]
+        private static extern long YoloV5EstimateMemory(IntPtr yolov5, int height, int width, int channels, int batch);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5TraceStart", CallingConvention = CallingConvention.Cdecl)]
+        private static extern void YoloV5TraceStart(IntPtr yolov5, bool torchOps);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5TraceStop", CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool YoloV5TraceStop(IntPtr yolov5, string path);
+
         [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5Preditct", CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr YoloV5Preditct(IntPtr yolov5, IntPtr cvMat);
 
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5PreditctFromBuffer", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5PreditctFromBuffer(IntPtr yolov5, IntPtr data, int width, int height, int stride, int pixelFormat);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5PreditctWithSize", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5PreditctWithSize(IntPtr yolov5, IntPtr cvMat, int height, int width);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5PreditctRois", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5PreditctRois(IntPtr yolov5, IntPtr cvMat, int[] rects, int roiCount);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5PreditctMask", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5PreditctMask(IntPtr yolov5, IntPtr cvMat, IntPtr cvMask, int minArea);
+
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5WarmUp", CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool YoloV5WarmUp(IntPtr yolov5, int[] heights, int[] widths, int length, int iterations);
+
         [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5Preditcts", CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr YoloV5Preditcts(IntPtr yolov5, IntPtr[] matArr, int matArrLength);
 
+        [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5PreditctsMosaic", CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr YoloV5PreditctsMosaic(IntPtr yolov5, IntPtr[] matArr, int matArrLength, int gutter, float minScale);
+
         [DllImport("YoloV5TorchCpp.dll", EntryPoint = "YoloV5ResultAt", CallingConvention = CallingConvention.Cdecl)]
         private static extern YoloResult YoloV5ResultAt(IntPtr result, int index);
 
@@ -168,6 +249,24 @@ namespace YoloV5Torch
             this.Ptr = YoloV5New(torchscriptPath, isCuda, isHalf, height, width, confThres, iouThres);
         }
 
+        /// <summary>
+        /// Constructor using a directory of frozen modules, the artifact is built on the first construction
+        /// </summary>
+        /// <param name="torchscriptPath">path of torchscript</param>
+        /// <param name="cacheDirectory">directory of the frozen modules</param>
+        /// <param name="isCuda">is using cuda</param>
+        /// <param name="isHalf">is half precision</param>
+        /// <param name="height">height of model</param>
+        /// <param name="width">width of model</param>
+        /// <param name="confThres">confidence threshold</param>
+        /// <param name="iouThres">iou threshold</param>
+        public YoloV5(string torchscriptPath, string cacheDirectory,
+            bool isCuda, bool isHalf = false, int height = 640, int width = 640, float confThres = 0.25f, float iouThres = 0.45f)
+        {
+            Initialize(isCuda, isHalf, height, width, confThres, iouThres);
+            this.Ptr = YoloV5NewCached(torchscriptPath, cacheDirectory, isCuda, isHalf, height, width, confThres, iouThres);
+        }
+
         /// <summary>
         /// Constructor
         /// </summary>
@@ -203,6 +302,27 @@ namespace YoloV5Torch
             this.Ptr = YoloV5New(bytes, bytes.Length, isCuda, isHalf, height, width, confThres, iouThres);
         }
 
+        /// <summary>
+        /// Milliseconds spent in the constructor (loading, conversion and warm up)
+        /// </summary>
+        public double ColdStartMs
+        {
+            get
+            {
+                return YoloV5ColdStartMs(Ptr);
+            }
+        }
+
+        /// <summary>
+        /// Run the model in channels_last memory format, on cpu with weights prepacked for oneDNN.
+        /// The conversion cannot be undone.
+        /// </summary>
+        /// <returns>false if the oneDNN optimization failed</returns>
+        public bool EnableChannelsLast()
+        {
+            return YoloV5EnableChannelsLast(Ptr);
+        }
+
         /// <summary>
         /// Initialize variables
         /// </summary>
@@ -236,6 +356,117 @@ namespace YoloV5Torch
             }
         }
 
+        /// <summary>
+        /// Warm up torch for each input resolution
+        /// </summary>
+        /// <param name="sizes">input resolutions (width, height)</param>
+        /// <param name="iterations">forward passes for each resolution</param>
+        /// <returns>is warm up succeeded</returns>
+        public bool WarmUp(IEnumerable<Size> sizes, int iterations = 2)
+        {
+            int[] heights = sizes.Select(size => size.Height).ToArray();
+            int[] widths = sizes.Select(size => size.Width).ToArray();
+            return YoloV5WarmUp(Ptr, heights, widths, heights.Length, iterations);
+        }
+
+        /// <summary>
+        /// Set the filter applied before non maximum suppression
+        /// </summary>
+        /// <param name="classes">class indices to keep (null to keep every class)</param>
+        /// <param name="classThres">confidence threshold of a class index (classes not listed use ConfThres)</param>
+        /// <param name="agnostic">suppress overlapping boxes across classes</param>
+        /// <param name="maxCandidates">maximum boxes sorted into non maximum suppression</param>
+        /// <param name="maxDetections">maximum boxes kept after non maximum suppression (0 for no limit)</param>
+        public void SetFilter(IEnumerable<int> classes = null, IDictionary<int, float> classThres = null,
+            bool agnostic = false, int maxCandidates = 30000, int maxDetections = 0)
+        {
+            int[] classArr = classes == null ? new int[0] : classes.ToArray();
+            int[] thresClasses = classThres == null ? new int[0] : classThres.Keys.ToArray();
+            float[] thresValues = classThres == null ? new float[0] : thresClasses.Select(clazz => classThres[clazz]).ToArray();
+            YoloV5SetFilter(Ptr, classArr, classArr.Length, thresClasses, thresValues, thresClasses.Length,
+                agnostic, maxCandidates, maxDetections);
+        }
+
+        /// <summary>
+        /// Cache the results of single image predictions by image content
+        /// </summary>
+        /// <param name="byteBudget">maximum bytes of the cached results (0 to disable the cache)</param>
+        public void EnableCache(long byteBudget)
+        {
+            YoloV5EnableCache(Ptr, byteBudget);
+        }
+
+        /// <summary>
+        /// Get counters of the result cache
+        /// </summary>
+        /// <param name="hits">number of found results</param>
+        /// <param name="misses">number of missing results</param>
+        /// <param name="evictions">number of evicted results</param>
+        /// <param name="bytes">bytes of the cached results</param>
+        /// <returns>false if the cache is disabled</returns>
+        public bool GetCacheStats(out long hits, out long misses, out long evictions, out long bytes)
+        {
+            return YoloV5CacheStats(Ptr, out hits, out misses, out evictions, out bytes);
+        }
+
+        /// <summary>
+        /// Bound the memory of the instance, batches are split to fit and an image that cannot fit is rejected
+        /// </summary>
+        /// <param name="byteBudget">maximum bytes of the weights and the buffers of the running predictions (0 for no limit)</param>
+        public void SetMemoryBudget(long byteBudget)
+        {
+            YoloV5SetMemoryBudget(Ptr, byteBudget);
+        }
+
+        /// <summary>
+        /// Get the bytes accounted to the instance
+        /// </summary>
+        /// <param name="weights">bytes of the model weights</param>
+        /// <param name="input">bytes of the letterboxed images and input tensors in use</param>
+        /// <param name="scratch">bytes of the raw model output in use</param>
+        /// <param name="candidates">bytes of the non maximum suppression candidates in use</param>
+        /// <param name="current">sum of the bytes in use</param>
+        /// <param name="peak">highest sum since the construction</param>
+        /// <param name="budget">memory budget (0 when unlimited)</param>
+        /// <returns>false if the object is disposed</returns>
+        public bool GetMemoryStats(out long weights, out long input, out long scratch,
+            out long candidates, out long current, out long peak, out long budget)
+        {
+            return YoloV5MemoryStats(Ptr, out weights, out input, out scratch, out candidates, out current, out peak, out budget);
+        }
+
+        /// <summary>
+        /// Estimate the bytes of the buffers of a batch prediction
+        /// </summary>
+        /// <param name="height">input height</param>
+        /// <param name="width">input width</param>
+        /// <param name="channels">channels of the images</param>
+        /// <param name="batch">images in the batch</param>
+        /// <returns>estimated bytes</returns>
+        public long EstimateMemory(int height, int width, int channels, int batch)
+        {
+            return YoloV5EstimateMemory(Ptr, height, width, channels, batch);
+        }
+
+        /// <summary>
+        /// Start recording the spans of the prediction stages
+        /// </summary>
+        /// <param name="torchOps">also record the libtorch operators</param>
+        public void StartTrace(bool torchOps = false)
+        {
+            YoloV5TraceStart(Ptr, torchOps);
+        }
+
+        /// <summary>
+        /// Stop recording and write the spans as a Chrome trace json file
+        /// </summary>
+        /// <param name="path">json path (open with chrome://tracing or ui.perfetto.dev)</param>
+        /// <returns>false if the file cannot be written</returns>
+        public bool StopTrace(string path)
+        {
+            return YoloV5TraceStop(Ptr, path);
+        }
+
         /// <summary>
         /// Read all bytes from stream
         /// </summary>
@@ -255,17 +486,126 @@ namespace YoloV5Torch
         /// <returns>Prediction result of the bitmap</returns>
         public YoloResult[] Predict(Bitmap bitmap)
         {
+            YoloPixelFormat format;
+            switch (bitmap.PixelFormat)
+            {
+                case PixelFormat.Format24bppRgb:
+                    format = YoloPixelFormat.BGR;
+                    break;
+                case PixelFormat.Format32bppArgb:
+                case PixelFormat.Format32bppRgb:
+                    format = YoloPixelFormat.BGRA;
+                    break;
+                default:
+                    IntPtr matPtr = OpenCv.BitmapToMatPtr(bitmap);
+                    IntPtr matResults = YoloV5Preditct(Ptr, matPtr);
+                    OpenCv.DeleteMat(matPtr);
+                    return ToYoloResults(matResults);
+            }
+
+            // the locked bits are read in place, without copying the rows
+            var rect = new Rectangle(0, 0, bitmap.Width, bitmap.Height);
+            BitmapData bmpData = bitmap.LockBits(rect, ImageLockMode.ReadOnly, bitmap.PixelFormat);
+            if (bmpData.Stride < 0)
+            {
+                // bottom-up bitmap, its rows are copied top-down into a mat
+                bitmap.UnlockBits(bmpData);
+                IntPtr bottomUpMatPtr = OpenCv.BitmapToMatPtr(bitmap);
+                IntPtr bottomUpResults = YoloV5Preditct(Ptr, bottomUpMatPtr);
+                OpenCv.DeleteMat(bottomUpMatPtr);
+                return ToYoloResults(bottomUpResults);
+            }
+            try
+            {
+                return Predict(bmpData.Scan0, bitmap.Width, bitmap.Height, bmpData.Stride, format);
+            }
+            finally
+            {
+                bitmap.UnlockBits(bmpData);
+            }
+        }
+
+        /// <summary>
+        /// Predict by image memory, read in place without copying
+        /// </summary>
+        /// <param name="data">first pixel of the image (or of the region of interest)</param>
+        /// <param name="width">width in pixels</param>
+        /// <param name="height">height in pixels</param>
+        /// <param name="stride">bytes between the starts of two rows (rows top-down, not negative)</param>
+        /// <param name="format">pixel format</param>
+        /// <returns>Prediction result of the image</returns>
+        public YoloResult[] Predict(IntPtr data, int width, int height, int stride, YoloPixelFormat format)
+        {
+            if (stride < 0)
+                throw new ArgumentException("negative stride (bottom-up image) is not supported, pass the Bitmap instead", "stride");
+
+            IntPtr cppResults = YoloV5PreditctFromBuffer(Ptr, data, width, height, stride, (int)format);
+            return ToYoloResults(cppResults);
+        }
+
+        /// <summary>
+        /// Predict by bitmap with a different input resolution
+        /// </summary>
+        /// <param name="bitmap">bitmap</param>
+        /// <param name="height">input height of this prediction</param>
+        /// <param name="width">input width of this prediction</param>
+        /// <returns>Prediction result of the bitmap</returns>
+        public YoloResult[] Predict(Bitmap bitmap, int height, int width)
+        {
+            IntPtr matPtr = OpenCv.BitmapToMatPtr(bitmap);
+            IntPtr cppResults = YoloV5PreditctWithSize(Ptr, matPtr, height, width);
+            OpenCv.DeleteMat(matPtr);
+            return ToYoloResults(cppResults);
+        }
+
+        /// <summary>
+        /// Predict only regions of interest of a bitmap, overlapping regions are merged
+        /// </summary>
+        /// <param name="bitmap">bitmap</param>
+        /// <param name="rois">regions of interest (none for the whole bitmap)</param>
+        /// <returns>Prediction result in bitmap coordinates</returns>
+        public YoloResult[] Predict(Bitmap bitmap, IEnumerable<Rectangle> rois)
+        {
+            int[] rects = rois.SelectMany(r => new int[] { r.X, r.Y, r.Width, r.Height }).ToArray();
             IntPtr matPtr = OpenCv.BitmapToMatPtr(bitmap);
-            IntPtr cppResults = YoloV5Preditct(Ptr, matPtr);
+            IntPtr cppResults = YoloV5PreditctRois(Ptr, matPtr, rects, rects.Length / 4);
             OpenCv.DeleteMat(matPtr);
+            return ToYoloResults(cppResults);
+        }
+
+        /// <summary>
+        /// Predict only the regions of a mask (bounding rectangles of its connected components)
+        /// </summary>
+        /// <param name="bitmap">bitmap</param>
+        /// <param name="mask">mask of the bitmap, non black pixels are of interest</param>
+        /// <param name="minArea">smallest region kept in pixels</param>
+        /// <returns>Prediction result in bitmap coordinates</returns>
+        public YoloResult[] Predict(Bitmap bitmap, Bitmap mask, int minArea = 64)
+        {
+            IntPtr matPtr = OpenCv.BitmapToMatPtr(bitmap);
+            IntPtr maskPtr = OpenCv.BitmapToMatPtr(mask);
+            IntPtr cppResults = YoloV5PreditctMask(Ptr, matPtr, maskPtr, minArea);
+            OpenCv.DeleteMat(maskPtr);
+            OpenCv.DeleteMat(matPtr);
+            return ToYoloResults(cppResults);
+        }
+
+        /// <summary>
+        /// Copy C++ prediction result and delete it
+        /// </summary>
+        /// <param name="cppResults">pointer of C++ prediction result</param>
+        /// <returns>Prediction result</returns>
+        private static YoloResult[] ToYoloResults(IntPtr cppResults)
+        {
+            if (cppResults == IntPtr.Zero)
+                return new YoloResult[0];
 
             int length = YoloV5ResultSize(cppResults);
             YoloResult[] result = new YoloResult[length];
-            Parallel.For(0, length, i =>
+            for (int i = 0; i < length; i++)
             {
-                var item = YoloV5ResultAt(cppResults, i);
-                result[i] = item;
-            });
+                result[i] = YoloV5ResultAt(cppResults, i);
+            }
             YoloV5ResultDelete(cppResults);
             return result;
         }
@@ -309,6 +649,43 @@ namespace YoloV5Torch
             return results;
         }
 
+        /// <summary>
+        /// Predict small bitmaps tiled together into shared model inputs (several frames per forward pass)
+        /// </summary>
+        /// <param name="bitmaps">bitmap collection of one pixel format</param>
+        /// <param name="gutter">black pixels between two tiles</param>
+        /// <param name="minScale">smallest scale accepted to fit more tiles in one input</param>
+        /// <returns>Prediction result of bitmap collection</returns>
+        public YoloResult[][] PredictsMosaic(IEnumerable<Bitmap> bitmaps, int gutter = 16, float minScale = 0.9f)
+        {
+            IntPtr[] mats = bitmaps.Select(bitmap => OpenCv.BitmapToMatPtr(bitmap)).ToArray();
+            IntPtr cppResult = YoloV5PreditctsMosaic(Ptr, mats, mats.Length, gutter, minScale);
+            foreach (IntPtr matPtr in mats)
+            {
+                OpenCv.DeleteMat(matPtr);
+            }
+            if (cppResult == IntPtr.Zero)
+            {
+                return null;
+            }
+
+            int resultLength = YoloV5ResultsSize(cppResult);
+            YoloResult[][] results = new YoloResult[resultLength][];
+            for (int i = 0; i < resultLength; i++)
+            {
+                IntPtr items = YoloV5ResultsAt(cppResult, i);
+                int itemsLength = YoloV5ResultSize(items);
+                results[i] = new YoloResult[itemsLength];
+                for (int j = 0; j < itemsLength; j++)
+                {
+                    results[i][j] = YoloV5ResultAt(items, j);
+                }
+                YoloV5ResultDelete(items);
+            }
+            YoloV5ResultsDelete(cppResult);
+            return results;
+        }
+
         /// <summary>
         /// Call it when finish using the object
         /// </summary>
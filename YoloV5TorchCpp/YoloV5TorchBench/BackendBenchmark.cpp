@@ -0,0 +1,73 @@
+﻿#include "BackendBenchmark.h"
+#include "OnnxRuntimeBackend.h"
+#include <chrono>
+#include <cstdio>
+
+BackendBenchmark::BackendBenchmark(const std::string& torchScriptPath, const std::string& onnxPath, int threads,
+	int height, int width, int iterations)
+{
+	this->torchScriptPath = torchScriptPath;
+	this->onnxPath = onnxPath;
+	this->threads = std::max(1, threads);
+	this->height = height;
+	this->width = width;
+	this->iterations = std::max(1, iterations);
+}
+
+double BackendBenchmark::throughput(YoloV5& yolov5, const cv::Mat& frame, int batch)
+{
+	std::vector<cv::Mat> frames(batch, frame);
+
+	// warm up the engine on this batch size
+	for (int i = 0; i < 3; i++)
+	{
+		yolov5.prediction(frames);
+	}
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		yolov5.prediction(frames);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return iterations * batch / seconds;
+}
+
+bool BackendBenchmark::run()
+{
+#ifdef YOLOV5_WITH_ONNXRUNTIME
+	torch::set_num_threads(threads);
+	YoloV5 torchScript(torchScriptPath, false, false, height, width);
+	YoloV5 onnxRuntime(std::make_shared<OnnxRuntimeBackend>(onnxPath, threads), height, width);
+
+	cv::Mat frame(720, 1280, CV_8UC3);
+	cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+	for (int i = 0; i < 10; i++)
+	{
+		cv::circle(frame, cv::Point(100 + i * 110, 200 + (i % 3) * 150), 40, cv::Scalar(20 * i, 255 - 20 * i, 128), cv::FILLED);
+	}
+
+	// same pre and postprocessing, the detections only differ by the numerics of the engines
+	torch::Tensor a = torchScript.prediction(frame)[0].cpu();
+	torch::Tensor b = onnxRuntime.prediction(frame)[0].cpu();
+	double maxBoxDiff = 0;
+	if (a.size(0) == b.size(0) && a.size(0) > 0)
+	{
+		maxBoxDiff = (a.slice(1, 0, 4) - b.slice(1, 0, 4)).abs().max().item<double>();
+	}
+	std::printf("detections torchscript %d  onnxruntime %d  max box difference %.3f px\n",
+		(int)a.size(0), (int)b.size(0), maxBoxDiff);
+
+	int batches[] = { 1, 4 };
+	for (int batch : batches)
+	{
+		double torchScriptRate = throughput(torchScript, frame, batch);
+		double onnxRuntimeRate = throughput(onnxRuntime, frame, batch);
+		std::printf("batch %d  torchscript %8.2f img/s  onnxruntime %8.2f img/s  speedup %5.2fx\n",
+			batch, torchScriptRate, onnxRuntimeRate, onnxRuntimeRate / torchScriptRate);
+	}
+	return true;
+#else
+	std::printf("built without YOLOV5_WITH_ONNXRUNTIME, the onnxruntime backend is not available\n");
+	return false;
+#endif
+}
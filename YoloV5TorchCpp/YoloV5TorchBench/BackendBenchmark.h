@@ -0,0 +1,44 @@
+﻿#pragma once
+#ifndef BACKENDBENCHMARK_H
+#define BACKENDBENCHMARK_H
+
+#include <string>
+#include "YoloV5.h"
+
+/**
+ * BackendBenchmark (throughput of the torchscript backend against the ONNX Runtime cpu backend)
+ */
+class BackendBenchmark
+{
+public:
+	/**
+	 * Constructor
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param onnxPath onnx export of the same model
+	 * @param threads intra operator threads of both engines
+	 * @param height input height
+	 * @param width input width
+	 * @param iterations timed predictions of each batch size
+	 */
+	BackendBenchmark(const std::string& torchScriptPath, const std::string& onnxPath, int threads,
+		int height, int width, int iterations);
+
+	/**
+	 * print images per second of both backends for batches of 1 and 4 frames and the detections they agree on
+	 * @return false if built without YOLOV5_WITH_ONNXRUNTIME
+	 */
+	bool run();
+
+private:
+	std::string torchScriptPath;
+	std::string onnxPath;
+	int threads;
+	int height;
+	int width;
+	int iterations;
+
+	// images per second of a batch size
+	double throughput(YoloV5& yolov5, const cv::Mat& frame, int batch);
+};
+
+#endif // !BACKENDBENCHMARK_H
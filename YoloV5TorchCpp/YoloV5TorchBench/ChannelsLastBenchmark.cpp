@@ -0,0 +1,55 @@
+﻿#include "ChannelsLastBenchmark.h"
+#include <chrono>
+#include <cstdio>
+
+ChannelsLastBenchmark::ChannelsLastBenchmark(const std::string& torchScriptPath, bool isCuda, bool isHalf,
+	int height, int width, int iterations)
+{
+	this->torchScriptPath = torchScriptPath;
+	this->isCuda = isCuda;
+	this->isHalf = isHalf;
+	this->height = height;
+	this->width = width;
+	this->iterations = std::max(1, iterations);
+}
+
+double ChannelsLastBenchmark::throughput(YoloV5& yolov5, int batch)
+{
+	cv::Mat frame(720, 1280, CV_8UC3);
+	cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+	std::vector<cv::Mat> frames(batch, frame);
+
+	// warm up the executor on this batch size
+	for (int i = 0; i < 3; i++)
+	{
+		yolov5.prediction(frames);
+	}
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		yolov5.prediction(frames);
+	}
+	if (isCuda)
+	{
+		torch::cuda::synchronize();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	return iterations * batch / seconds;
+}
+
+void ChannelsLastBenchmark::run()
+{
+	YoloV5 contiguous(torchScriptPath, isCuda, isHalf, height, width);
+	YoloV5 channelsLast(torchScriptPath, isCuda, isHalf, height, width);
+	bool optimized = channelsLast.enableChannelsLast();
+	std::printf("channels_last %s\n", optimized ? "with oneDNN prepacking" : "without oneDNN prepacking (optimize_for_inference failed)");
+
+	int batches[] = { 1, 4 };
+	for (int batch : batches)
+	{
+		double contiguousRate = throughput(contiguous, batch);
+		double channelsLastRate = throughput(channelsLast, batch);
+		std::printf("batch %d  contiguous %8.2f img/s  channels_last %8.2f img/s  speedup %5.2fx\n",
+			batch, contiguousRate, channelsLastRate, channelsLastRate / contiguousRate);
+	}
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+#ifndef CHANNELSLASTBENCHMARK_H
+#define CHANNELSLASTBENCHMARK_H
+
+#include <string>
+#include "YoloV5.h"
+
+/**
+ * ChannelsLastBenchmark (throughput of the default execution against channels_last with oneDNN prepacking)
+ */
+class ChannelsLastBenchmark
+{
+public:
+	/**
+	 * Constructor
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param isCuda is using Cuda
+	 * @param isHalf is using half precision
+	 * @param height input height
+	 * @param width input width
+	 * @param iterations timed predictions of each batch size
+	 */
+	ChannelsLastBenchmark(const std::string& torchScriptPath, bool isCuda, bool isHalf,
+		int height, int width, int iterations);
+
+	// print images per second of both modes for batches of 1 and 4 frames
+	void run();
+
+private:
+	std::string torchScriptPath;
+	bool isCuda;
+	bool isHalf;
+	int height;
+	int width;
+	int iterations;
+
+	// images per second of a batch size
+	double throughput(YoloV5& yolov5, int batch);
+};
+
+#endif // !CHANNELSLASTBENCHMARK_H
@@ -0,0 +1,52 @@
+﻿#include "ColdStartBenchmark.h"
+#include <chrono>
+#include <cstdio>
+
+ColdStartBenchmark::ColdStartBenchmark(const std::string& torchScriptPath, const std::string& cacheDirectory,
+	bool isCuda, bool isHalf, int height, int width)
+{
+	this->torchScriptPath = torchScriptPath;
+	this->cacheDirectory = cacheDirectory;
+	this->isCuda = isCuda;
+	this->isHalf = isHalf;
+	this->height = height;
+	this->width = width;
+}
+
+void ColdStartBenchmark::report(const std::string& name, YoloV5& yolov5)
+{
+	cv::Mat frame(720, 1280, CV_8UC3, cv::Scalar(114, 114, 114));
+	double frameMs[3];
+	for (int i = 0; i < 3; i++)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		yolov5.prediction(frame);
+		if (isCuda)
+		{
+			torch::cuda::synchronize();
+		}
+		frameMs[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	}
+	std::printf("%-16s constructor %9.1f ms  frame 1 %8.1f ms  frame 2 %8.1f ms  frame 3 %8.1f ms  first hot frame at %9.1f ms\n",
+		name.c_str(), yolov5.getColdStartMs(), frameMs[0], frameMs[1], frameMs[2], yolov5.getColdStartMs() + frameMs[0]);
+}
+
+void ColdStartBenchmark::run(const std::string& mode)
+{
+	if (mode == "plain" || mode == "both")
+	{
+		YoloV5 yolov5(torchScriptPath, isCuda, isHalf, height, width);
+		report("plain", yolov5);
+	}
+	if (mode == "cached" || mode == "both")
+	{
+		ModuleCache cache(cacheDirectory);
+		YoloV5 yolov5(torchScriptPath, cache, isCuda, isHalf, height, width);
+		report(cache.getLastHit() ? "cached (hit)" : "cached (miss)", yolov5);
+		if (mode == "both" && !cache.getLastHit())
+		{
+			YoloV5 hot(torchScriptPath, cache, isCuda, isHalf, height, width);
+			report("cached (hit)", hot);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+#ifndef COLDSTARTBENCHMARK_H
+#define COLDSTARTBENCHMARK_H
+
+#include <string>
+#include "YoloV5.h"
+
+/**
+ * ColdStartBenchmark (time to the first hot frame with and without the ModuleCache)
+ * A true cold start is measured by running each mode in its own process.
+ */
+class ColdStartBenchmark
+{
+public:
+	/**
+	 * Constructor
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param cacheDirectory directory of the frozen modules
+	 * @param isCuda is using Cuda
+	 * @param isHalf is using half precision
+	 * @param height input height
+	 * @param width input width
+	 */
+	ColdStartBenchmark(const std::string& torchScriptPath, const std::string& cacheDirectory,
+		bool isCuda, bool isHalf, int height, int width);
+
+	/**
+	 * Construct and predict the first frames
+	 * @param mode "plain" (torch::jit::load), "cached" (ModuleCache) or "both"
+	 */
+	void run(const std::string& mode);
+
+private:
+	std::string torchScriptPath;
+	std::string cacheDirectory;
+	bool isCuda;
+	bool isHalf;
+	int height;
+	int width;
+
+	// predict the first frames and print the timings
+	void report(const std::string& name, YoloV5& yolov5);
+};
+
+#endif // !COLDSTARTBENCHMARK_H
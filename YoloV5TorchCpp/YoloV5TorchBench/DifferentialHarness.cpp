@@ -0,0 +1,265 @@
+﻿#include "DifferentialHarness.h"
+#include "YoloV5Reference.h"
+#include <chrono>
+#include <cstdio>
+
+DifferentialHarness::DifferentialHarness(unsigned seed, int repeats)
+	: random(seed), yolov5(identityModel())
+{
+	this->repeats = std::max(1, repeats);
+	this->failures = 0;
+	torch::manual_seed(seed);
+
+	// the reference keeps every box after non maximum suppression and sorts at most 30000
+	DetectionFilter filter;
+	filter.maxCandidates = 30000;
+	filter.maxDetections = 0;
+	yolov5.setFilter(filter);
+}
+
+torch::jit::script::Module DifferentialHarness::identityModel()
+{
+	torch::jit::script::Module model("Identity");
+	model.define("def forward(self, x):\n  return (x,)\n");
+	return model;
+}
+
+void DifferentialHarness::report(const std::string& name, bool equal, double referenceMs, double optimizedMs)
+{
+	if (!equal)
+	{
+		failures++;
+	}
+	std::printf("%-44s %-4s reference %9.3f ms  optimized %9.3f ms  speedup %7.2fx\n", name.c_str(),
+		equal ? "ok" : "FAIL", referenceMs, optimizedMs, optimizedMs > 0 ? referenceMs / optimizedMs : 0.0);
+}
+
+double DifferentialHarness::timeMs(const std::function<void()>& function)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++)
+	{
+		function();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / repeats;
+}
+
+bool DifferentialHarness::equal(const std::vector<torch::Tensor>& reference, const std::vector<torch::Tensor>& optimized)
+{
+	if (reference.size() != optimized.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < reference.size(); i++)
+	{
+		if (reference[i].sizes() != optimized[i].sizes())
+		{
+			return false;
+		}
+		if (reference[i].numel() > 0 && !torch::allclose(reference[i].toType(torch::kFloat),
+			optimized[i].toType(torch::kFloat), 1e-5, 1e-3))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+torch::Tensor DifferentialHarness::randomBoxes(int n, int clusters)
+{
+	std::uniform_real_distribution<float> position(-20, 660);
+	std::uniform_real_distribution<float> size(0, 200);
+	std::normal_distribution<float> jitter(0, 3);
+	std::vector<float> centers;
+	for (int i = 0; i < clusters * 4; i++)
+	{
+		centers.push_back(i % 4 < 2 ? position(random) : size(random));
+	}
+
+	torch::Tensor boxes = torch::empty({ n, 4 }, torch::kFloat);
+	float* b = boxes.data_ptr<float>();
+	for (int i = 0; i < n; i++)
+	{
+		float cx, cy, w, h;
+		if (clusters > 0)
+		{
+			int c = i % clusters;
+			cx = centers[c * 4] + jitter(random);
+			cy = centers[c * 4 + 1] + jitter(random);
+			w = std::max(0.0f, centers[c * 4 + 2] + jitter(random));
+			h = std::max(0.0f, centers[c * 4 + 3] + jitter(random));
+		}
+		else
+		{
+			cx = position(random);
+			cy = position(random);
+			w = size(random);
+			h = size(random);
+		}
+		b[i * 4] = cx - w / 2;
+		b[i * 4 + 1] = cy - h / 2;
+		b[i * 4 + 2] = cx + w / 2;
+		b[i * 4 + 3] = cy + h / 2;
+	}
+	return boxes;
+}
+
+torch::Tensor DifferentialHarness::randomPredictions(int batch, int n, int classes, int clusters, bool ties)
+{
+	torch::Tensor preds = torch::rand({ batch, n, 5 + classes });
+	for (int i = 0; i < batch; i++)
+	{
+		torch::Tensor xyxy = randomBoxes(n, clusters);
+		preds[i].slice(1, 0, 2).copy_((xyxy.slice(1, 0, 2) + xyxy.slice(1, 2, 4)) / 2);
+		preds[i].slice(1, 2, 4).copy_(xyxy.slice(1, 2, 4) - xyxy.slice(1, 0, 2));
+	}
+	if (ties)
+	{
+		preds.slice(2, 4, 5 + classes).mul_(4).round_().div_(4);
+	}
+	return preds;
+}
+
+cv::Mat DifferentialHarness::randomImage(int rows, int cols, int type, bool roi)
+{
+	int margin = roi ? 7 : 0;
+	cv::Mat img(rows + 2 * margin, cols + 3 * margin, type);
+	cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(256));
+	return img(cv::Rect(2 * margin, margin, cols, rows));
+}
+
+void DifferentialHarness::checkNms(const std::string& name, const torch::Tensor& boxes, const torch::Tensor& scores, float thres)
+{
+	torch::Tensor reference = YoloV5Reference::nms(boxes, scores, thres);
+	torch::Tensor optimized = yolov5.nms(boxes, scores, thres);
+	bool same = reference.numel() == optimized.numel() &&
+		(reference.numel() == 0 || torch::equal(reference.toType(torch::kLong), optimized.toType(torch::kLong)));
+
+	double referenceMs = timeMs([&]() { YoloV5Reference::nms(boxes, scores, thres); });
+	double optimizedMs = timeMs([&]() { yolov5.nms(boxes, scores, thres); });
+	report("nms " + name, same, referenceMs, optimizedMs);
+}
+
+void DifferentialHarness::checkNonMaxSuppression(const std::string& name, const torch::Tensor& preds)
+{
+	// the reference scales the class scores in place
+	std::vector<torch::Tensor> reference = YoloV5Reference::non_max_suppression(preds.clone());
+	std::vector<torch::Tensor> optimized = yolov5.non_max_suppression(preds.clone());
+
+	double referenceMs = timeMs([&]() { YoloV5Reference::non_max_suppression(preds.clone()); });
+	double optimizedMs = timeMs([&]() { yolov5.non_max_suppression(preds.clone()); });
+	report("non_max_suppression " + name, equal(reference, optimized), referenceMs, optimizedMs);
+}
+
+void DifferentialHarness::checkSizeOriginal(const std::string& name, int originalHeight, int originalWidth, int boxes)
+{
+	cv::Mat img(originalHeight, originalWidth, CV_8UC1, cv::Scalar::all(0));
+	std::vector<ResizedMatData> imgRDs;
+	imgRDs.push_back(ResizedMatData::resize(img, 640, 640));
+	std::vector<torch::Tensor> result;
+	result.push_back(torch::cat({ randomBoxes(boxes, 0), torch::rand({ boxes, 1 }),
+		torch::randint(0, 80, { boxes, 1 }).toType(torch::kFloat) }, 1));
+
+	// both rescale in place
+	std::vector<torch::Tensor> reference = YoloV5Reference::sizeOriginal({ result[0].clone() }, imgRDs);
+	std::vector<torch::Tensor> optimized = yolov5.sizeOriginal({ result[0].clone() }, imgRDs);
+
+	double referenceMs = timeMs([&]() { YoloV5Reference::sizeOriginal({ result[0].clone() }, imgRDs); });
+	double optimizedMs = timeMs([&]() { yolov5.sizeOriginal({ result[0].clone() }, imgRDs); });
+	report("sizeOriginal " + name, equal(reference, optimized), referenceMs, optimizedMs);
+}
+
+void DifferentialHarness::checkPreprocess(const std::string& name, const cv::Mat& img, int height, int width)
+{
+	std::function<torch::Tensor()> reference = [&]()
+	{
+		ResizedMatData imgRD = YoloV5Reference::resize(img, height, width);
+		cv::Mat rgb = YoloV5Reference::img2RGB(imgRD.getMat());
+		return YoloV5Reference::img2Tensor(rgb, height, width);
+	};
+	std::function<torch::Tensor()> optimized = [&]()
+	{
+		ResizedMatData imgRD = ResizedMatData::resize(img, height, width);
+		return yolov5.img2Tensor(imgRD.getMat(), YoloV5::matFormat(img));
+	};
+
+	bool same = equal({ reference() }, { optimized() });
+	double referenceMs = timeMs([&]() { reference(); });
+	double optimizedMs = timeMs([&]() { optimized(); });
+	report("preprocess " + name, same, referenceMs, optimizedMs);
+}
+
+void DifferentialHarness::checkResize(const std::string& name, const cv::Mat& img, int height, int width)
+{
+	ResizedMatData optimized = ResizedMatData::resize(img, height, width);
+	cv::Mat optimizedMat = optimized.getMat();
+	bool valid = optimizedMat.rows == height && optimizedMat.cols == width && optimizedMat.type() == img.type();
+
+	double referenceMs = 0;
+	try
+	{
+		ResizedMatData reference = YoloV5Reference::resize(img, height, width);
+		cv::Mat referenceMat = reference.getMat();
+		bool same = valid && reference.getBorder() == optimized.getBorder() &&
+			referenceMat.size() == optimizedMat.size() && cv::norm(referenceMat, optimizedMat, cv::NORM_INF) == 0;
+		referenceMs = timeMs([&]() { YoloV5Reference::resize(img, height, width); });
+		double optimizedMs = timeMs([&]() { ResizedMatData::resize(img, height, width); });
+		report("resize " + name, same, referenceMs, optimizedMs);
+	}
+	catch (cv::Exception&)
+	{
+		// the reference resizes to an empty image, only the optimized letterbox is checked
+		double optimizedMs = timeMs([&]() { ResizedMatData::resize(img, height, width); });
+		report("resize " + name + " (reference rejects)", valid, 0, optimizedMs);
+	}
+}
+
+int DifferentialHarness::run()
+{
+	failures = 0;
+
+	checkNms("empty", torch::zeros({ 0, 4 }), torch::zeros({ 0 }), 0.45f);
+	checkNms("single", randomBoxes(1, 0), torch::rand({ 1 }), 0.45f);
+	checkNms("sparse 300", randomBoxes(300, 0), torch::rand({ 300 }), 0.45f);
+	checkNms("overlapping 2000 in 5", randomBoxes(2000, 5), torch::rand({ 2000 }), 0.45f);
+	checkNms("overlapping 3000 in 100", randomBoxes(3000, 100), torch::rand({ 3000 }), 0.45f);
+	checkNms("tied scores 1000", randomBoxes(1000, 20), torch::full({ 1000 }, 0.5f), 0.45f);
+	checkNms("degenerate boxes", torch::zeros({ 64, 4 }), torch::rand({ 64 }), 0.45f);
+	checkNms("iou 0", randomBoxes(500, 10), torch::rand({ 500 }), 0.0f);
+	checkNms("iou 1", randomBoxes(500, 10), torch::rand({ 500 }), 1.0f);
+
+	checkNonMaxSuppression("empty batch", torch::zeros({ 0, 100, 85 }));
+	checkNonMaxSuppression("no objects", torch::zeros({ 2, 1000, 85 }));
+	checkNonMaxSuppression("sparse 4x2000", randomPredictions(4, 2000, 80, 0, false));
+	checkNonMaxSuppression("overlapping 2x5000", randomPredictions(2, 5000, 80, 30, false));
+	checkNonMaxSuppression("tied scores 2x3000", randomPredictions(2, 3000, 3, 10, true));
+	checkNonMaxSuppression("one class 1x25200", randomPredictions(1, 25200, 1, 200, false));
+
+	checkSizeOriginal("wide 1920x1080", 1080, 1920, 300);
+	checkSizeOriginal("tall 1080x1920", 1920, 1080, 300);
+	checkSizeOriginal("square", 640, 640, 300);
+	checkSizeOriginal("empty", 480, 640, 0);
+	checkSizeOriginal("extreme 4000x7", 7, 4000, 100);
+
+	checkPreprocess("bgr 1920x1080", randomImage(1080, 1920, CV_8UC3, false), 640, 640);
+	checkPreprocess("bgr roi 1277x719", randomImage(719, 1277, CV_8UC3, true), 640, 640);
+	checkPreprocess("gray 640x480", randomImage(480, 640, CV_8UC1, false), 640, 640);
+	checkPreprocess("bgra roi 800x600", randomImage(600, 800, CV_8UC4, true), 640, 640);
+	checkPreprocess("bgr 320x256 input", randomImage(500, 333, CV_8UC3, false), 256, 320);
+
+	int sizes[][2] = { { 1, 1 }, { 1, 5000 }, { 5000, 1 }, { 3, 2000 }, { 2000, 3 }, { 640, 640 },
+		{ 639, 641 }, { 1080, 1920 }, { 1013, 37 } };
+	int types[] = { CV_8UC1, CV_8UC3, CV_8UC4 };
+	const char* typeNames[] = { "gray", "bgr", "bgra" };
+	for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		for (int t = 0; t < 3; t++)
+		{
+			std::string name = std::string(typeNames[t]) + " " + std::to_string(sizes[i][1]) + "x" + std::to_string(sizes[i][0]);
+			checkResize(name, randomImage(sizes[i][0], sizes[i][1], types[t], t == 2), 640, 640);
+		}
+	}
+
+	std::printf("%d case(s) differ\n", failures);
+	return failures;
+}
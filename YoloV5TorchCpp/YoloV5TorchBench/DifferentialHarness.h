@@ -0,0 +1,66 @@
+﻿#pragma once
+#ifndef DIFFERENTIALHARNESS_H
+#define DIFFERENTIALHARNESS_H
+
+#include <functional>
+#include <random>
+#include <string>
+#include "YoloV5.h"
+
+/**
+ * DifferentialHarness (runs the optimized pipeline stages of YoloV5 beside YoloV5Reference)
+ * Inputs are randomized and adversarial: overlapping boxes, tied scores, empty batches,
+ * extreme aspect ratios, gray and bgra images. Runs on cpu with an identity model.
+ */
+class DifferentialHarness
+{
+public:
+	/**
+	 * Constructor
+	 * @param seed seed of the random inputs
+	 * @param repeats timed runs of each implementation
+	 */
+	DifferentialHarness(unsigned seed = 0, int repeats = 5);
+
+	/**
+	 * Run every case and print the result and the speedup of each
+	 * @return number of cases where the implementations differ
+	 */
+	int run();
+
+private:
+	std::mt19937 random;
+	int repeats;
+	int failures;
+
+	// YoloV5 over a model returning its input, its prediction(tensor) is non_max_suppression only
+	YoloV5 yolov5;
+
+	// model whose forward returns (x,)
+	static torch::jit::script::Module identityModel();
+
+	// print a case and count the failure
+	void report(const std::string& name, bool equal, double referenceMs, double optimizedMs);
+
+	// mean milliseconds of a function over the repeats
+	double timeMs(const std::function<void()>& function);
+
+	void checkNms(const std::string& name, const torch::Tensor& boxes, const torch::Tensor& scores, float thres);
+	void checkNonMaxSuppression(const std::string& name, const torch::Tensor& preds);
+	void checkSizeOriginal(const std::string& name, int originalHeight, int originalWidth, int boxes);
+	void checkPreprocess(const std::string& name, const cv::Mat& img, int height, int width);
+	void checkResize(const std::string& name, const cv::Mat& img, int height, int width);
+
+	// xyxy boxes around a few centers when clusters > 0
+	torch::Tensor randomBoxes(int n, int clusters);
+
+	// raw yolov5 output (batch, n, 5 + classes), ties quantizes the scores
+	torch::Tensor randomPredictions(int batch, int n, int classes, int clusters, bool ties);
+
+	// random image, a region of interest of a larger one when roi is set
+	cv::Mat randomImage(int rows, int cols, int type, bool roi);
+
+	static bool equal(const std::vector<torch::Tensor>& reference, const std::vector<torch::Tensor>& optimized);
+};
+
+#endif // !DIFFERENTIALHARNESS_H
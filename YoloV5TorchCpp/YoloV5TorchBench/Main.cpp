@@ -0,0 +1,95 @@
+﻿#include "DifferentialHarness.h"
+#include "ColdStartBenchmark.h"
+#include "ChannelsLastBenchmark.h"
+#include "MosaicBenchmark.h"
+#include "BackendBenchmark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+/**
+ * YoloV5TorchBench
+ * usage: YoloV5TorchBench diff [seed] [repeats]
+ *        YoloV5TorchBench coldstart torchScriptPath cacheDirectory [plain|cached|both] [isCuda] [isHalf] [height] [width]
+ *        YoloV5TorchBench channelslast torchScriptPath [isCuda] [isHalf] [height] [width] [iterations]
+ *        YoloV5TorchBench mosaic torchScriptPath [isCuda] [frames] [frameWidth] [frameHeight] [gutter] [iterations]
+ *        YoloV5TorchBench backend torchScriptPath onnxPath [threads] [height] [width] [iterations]
+ *   diff          compare the optimized pipeline stages with the reference ones on cpu (exit code 1 if any differs)
+ *   coldstart     time to the first hot frame with torch::jit::load and with the ModuleCache
+ *   channelslast  throughput of the default execution and of channels_last with oneDNN prepacking
+ *   mosaic        cost per frame of letterboxed small frames and of frames tiled into shared inputs
+ *   backend       throughput of the torchscript and ONNX Runtime cpu backends (needs YOLOV5_WITH_ONNXRUNTIME)
+ */
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::printf("usage: YoloV5TorchBench diff [seed] [repeats]\n");
+		std::printf("       YoloV5TorchBench coldstart torchScriptPath cacheDirectory [plain|cached|both] [isCuda] [isHalf] [height] [width]\n");
+		std::printf("       YoloV5TorchBench channelslast torchScriptPath [isCuda] [isHalf] [height] [width] [iterations]\n");
+		std::printf("       YoloV5TorchBench mosaic torchScriptPath [isCuda] [frames] [frameWidth] [frameHeight] [gutter] [iterations]\n");
+		std::printf("       YoloV5TorchBench backend torchScriptPath onnxPath [threads] [height] [width] [iterations]\n");
+		return 2;
+	}
+
+	try
+	{
+		if (std::strcmp(argv[1], "diff") == 0)
+		{
+			unsigned seed = argc > 2 ? (unsigned)std::strtoul(argv[2], nullptr, 10) : 0;
+			int repeats = argc > 3 ? std::atoi(argv[3]) : 5;
+			DifferentialHarness harness(seed, repeats);
+			return harness.run() == 0 ? 0 : 1;
+		}
+		if (std::strcmp(argv[1], "coldstart") == 0 && argc > 3)
+		{
+			std::string mode = argc > 4 ? argv[4] : "both";
+			bool isCuda = argc > 5 && std::atoi(argv[5]) != 0;
+			bool isHalf = argc > 6 && std::atoi(argv[6]) != 0;
+			int height = argc > 7 ? std::atoi(argv[7]) : 640;
+			int width = argc > 8 ? std::atoi(argv[8]) : 640;
+			ColdStartBenchmark benchmark(argv[2], argv[3], isCuda, isHalf, height, width);
+			benchmark.run(mode);
+			return 0;
+		}
+		if (std::strcmp(argv[1], "channelslast") == 0 && argc > 2)
+		{
+			bool isCuda = argc > 3 && std::atoi(argv[3]) != 0;
+			bool isHalf = argc > 4 && std::atoi(argv[4]) != 0;
+			int height = argc > 5 ? std::atoi(argv[5]) : 640;
+			int width = argc > 6 ? std::atoi(argv[6]) : 640;
+			int iterations = argc > 7 ? std::atoi(argv[7]) : 50;
+			ChannelsLastBenchmark benchmark(argv[2], isCuda, isHalf, height, width, iterations);
+			benchmark.run();
+			return 0;
+		}
+		if (std::strcmp(argv[1], "mosaic") == 0 && argc > 2)
+		{
+			bool isCuda = argc > 3 && std::atoi(argv[3]) != 0;
+			int frames = argc > 4 ? std::atoi(argv[4]) : 16;
+			int frameWidth = argc > 5 ? std::atoi(argv[5]) : 320;
+			int frameHeight = argc > 6 ? std::atoi(argv[6]) : 240;
+			int gutter = argc > 7 ? std::atoi(argv[7]) : 16;
+			int iterations = argc > 8 ? std::atoi(argv[8]) : 20;
+			MosaicBenchmark benchmark(argv[2], isCuda, frames, frameWidth, frameHeight, gutter, iterations);
+			benchmark.run();
+			return 0;
+		}
+		if (std::strcmp(argv[1], "backend") == 0 && argc > 3)
+		{
+			int threads = argc > 4 ? std::atoi(argv[4]) : 4;
+			int height = argc > 5 ? std::atoi(argv[5]) : 640;
+			int width = argc > 6 ? std::atoi(argv[6]) : 640;
+			int iterations = argc > 7 ? std::atoi(argv[7]) : 50;
+			BackendBenchmark benchmark(argv[2], argv[3], threads, height, width, iterations);
+			return benchmark.run() ? 0 : 2;
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::printf("YoloV5TorchBench Exception: %s\n", ex.what());
+		return 1;
+	}
+	std::printf("unknown command %s\n", argv[1]);
+	return 2;
+}
@@ -0,0 +1,58 @@
+﻿#include "MosaicBenchmark.h"
+#include <chrono>
+#include <cstdio>
+
+MosaicBenchmark::MosaicBenchmark(const std::string& torchScriptPath, bool isCuda, int frames,
+	int frameWidth, int frameHeight, int gutter, int iterations)
+{
+	this->torchScriptPath = torchScriptPath;
+	this->isCuda = isCuda;
+	this->frames = std::max(1, frames);
+	this->frameWidth = frameWidth;
+	this->frameHeight = frameHeight;
+	this->gutter = gutter;
+	this->iterations = std::max(1, iterations);
+}
+
+double MosaicBenchmark::roundMs(const std::function<void()>& round)
+{
+	// warm up the executor on the batch sizes of a round
+	for (int i = 0; i < 3; i++)
+	{
+		round();
+	}
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		round();
+	}
+	if (isCuda)
+	{
+		torch::cuda::synchronize();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / iterations;
+}
+
+void MosaicBenchmark::run()
+{
+	YoloV5 yolov5(torchScriptPath, isCuda);
+	cv::Size inputSize = yolov5.getInputSize();
+	MosaicPacker packer(inputSize.height, inputSize.width, gutter);
+
+	std::vector<cv::Mat> mats;
+	for (int i = 0; i < frames; i++)
+	{
+		cv::Mat frame(frameHeight, frameWidth, CV_8UC3);
+		cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+		mats.push_back(frame);
+	}
+	std::vector<cv::Size> sizes(frames, cv::Size(frameWidth, frameHeight));
+	size_t canvases = packer.pack(sizes).size();
+
+	double letterboxMs = roundMs([&]() { yolov5.prediction(mats); });
+	double mosaicMs = roundMs([&]() { yolov5.prediction(mats, packer); });
+	std::printf("%d frames %dx%d, scale %.3f, %d inputs letterboxed, %d inputs tiled\n",
+		frames, frameWidth, frameHeight, packer.scaleOf(sizes[0]), frames, (int)canvases);
+	std::printf("letterbox %8.3f ms/frame  mosaic %8.3f ms/frame  speedup %5.2fx\n",
+		letterboxMs / frames, mosaicMs / frames, letterboxMs / mosaicMs);
+}
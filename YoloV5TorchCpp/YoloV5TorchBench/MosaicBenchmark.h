@@ -0,0 +1,44 @@
+﻿#pragma once
+#ifndef MOSAICBENCHMARK_H
+#define MOSAICBENCHMARK_H
+
+#include <functional>
+#include <string>
+#include "YoloV5.h"
+
+/**
+ * MosaicBenchmark (cost per stream of letterboxed small frames against frames tiled into shared inputs)
+ */
+class MosaicBenchmark
+{
+public:
+	/**
+	 * Constructor
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param isCuda is using Cuda
+	 * @param frames frames of one round (one per stream)
+	 * @param frameWidth width of the frames
+	 * @param frameHeight height of the frames
+	 * @param gutter black pixels between two tiles
+	 * @param iterations timed rounds
+	 */
+	MosaicBenchmark(const std::string& torchScriptPath, bool isCuda, int frames,
+		int frameWidth, int frameHeight, int gutter, int iterations);
+
+	// print milliseconds per frame of both modes and the number of forward inputs per round
+	void run();
+
+private:
+	std::string torchScriptPath;
+	bool isCuda;
+	int frames;
+	int frameWidth;
+	int frameHeight;
+	int gutter;
+	int iterations;
+
+	// milliseconds of one round of predictions
+	double roundMs(const std::function<void()>& round);
+};
+
+#endif // !MOSAICBENCHMARK_H
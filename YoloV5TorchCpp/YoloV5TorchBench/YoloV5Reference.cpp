@@ -0,0 +1,196 @@
+﻿#include "YoloV5Reference.h"
+
+ResizedMatData YoloV5Reference::resize(const cv::Mat& mat, int height, int width)
+{
+	cv::Mat resized;
+	int originalWidth = mat.cols, originalHeight = mat.rows;
+
+	int w = originalWidth;
+	int h = originalHeight;
+
+	bool isW = (float)w / (float)h > (float)width / (float)height;
+
+
+	cv::resize(mat, resized, cv::Size(
+		isW ? width : (int)((float)height / (float)h * w),
+		isW ? (int)((float)width / (float)w * h) : height));
+
+	w = resized.cols, h = resized.rows;
+
+	int border = 0;
+	if (isW)
+	{
+		border = (height - h) / 2;
+		cv::copyMakeBorder(resized, resized, (height - h) / 2, height - h - (height - h) / 2, 0, 0, cv::BORDER_CONSTANT);
+	}
+	else
+	{
+		border = (width - w) / 2;
+		cv::copyMakeBorder(resized, resized, 0, 0, (width - w) / 2, width - w - (width - w) / 2, cv::BORDER_CONSTANT);
+	}
+	return ResizedMatData(resized, originalWidth, originalHeight, border);
+}
+
+cv::Mat YoloV5Reference::img2RGB(const cv::Mat& img)
+{
+	int imgC = img.channels();
+	cv::Mat result;
+	if (imgC == 1)
+	{
+		cv::cvtColor(img, result, cv::COLOR_GRAY2RGB);
+	}
+	else
+	{
+		cv::cvtColor(img, result, cv::COLOR_BGR2RGB);
+	}
+	return result;
+}
+
+torch::Tensor YoloV5Reference::img2Tensor(const cv::Mat& img, int height, int width)
+{
+	torch::Tensor data = torch::from_blob(img.data, { height, width, 3 }, torch::kByte);
+	data = data.permute({ 2, 0, 1 });
+	data = data.toType(torch::kFloat);
+	data = data.div(255);
+	data = data.unsqueeze(0);
+	return data;
+}
+
+torch::Tensor YoloV5Reference::xywh2xyxy(const torch::Tensor& x)
+{
+	torch::Tensor y = x.clone();
+	y.select(1, 0) = x.select(1, 0) - x.select(1, 2) / 2;
+	y.select(1, 1) = x.select(1, 1) - x.select(1, 3) / 2;
+	y.select(1, 2) = x.select(1, 0) + x.select(1, 2) / 2;
+	y.select(1, 3) = x.select(1, 1) + x.select(1, 3) / 2;
+	return y;
+}
+
+torch::Tensor YoloV5Reference::nms(const torch::Tensor& bboxes, const torch::Tensor& scores, float thresh)
+{
+	auto x1 = bboxes.select(1, 0);
+	auto y1 = bboxes.select(1, 1);
+	auto x2 = bboxes.select(1, 2);
+	auto y2 = bboxes.select(1, 3);
+	auto areas = (x2 - x1) * (y2 - y1);
+	auto tuple_sorted = scores.sort(0, true);
+	auto order = std::get<1>(tuple_sorted);
+
+	std::vector<int> keep;
+	while (order.numel() > 0)
+	{
+		if (order.numel() == 1)
+		{
+			auto i = order.item();
+			keep.push_back(i.toInt());
+			break;
+		}
+		else
+		{
+			auto i = order[0].item();
+			keep.push_back(i.toInt());
+		}
+
+		auto order_mask = order.narrow(0, 1, order.size(-1) - 1);
+
+		auto xx1 = x1.index({ order_mask }).clamp(x1[keep.back()].item().toFloat(), 1e10);
+		auto yy1 = y1.index({ order_mask }).clamp(y1[keep.back()].item().toFloat(), 1e10);
+		auto xx2 = x2.index({ order_mask }).clamp(0, x2[keep.back()].item().toFloat());
+		auto yy2 = y2.index({ order_mask }).clamp(0, y2[keep.back()].item().toFloat());
+		auto inter = (xx2 - xx1).clamp(0, 1e10) * (yy2 - yy1).clamp(0, 1e10);
+
+		auto iou = inter / (areas[keep.back()] + areas.index({ order.narrow(0,1,order.size(-1) - 1) }) - inter);
+		auto idx = (iou <= thresh).nonzero().squeeze();
+		if (idx.numel() == 0)
+		{
+			break;
+		}
+		order = order.index({ idx + 1 });
+	}
+	return torch::tensor(keep);
+}
+
+std::vector<torch::Tensor> YoloV5Reference::sizeOriginal(const std::vector<torch::Tensor>& result,
+	const std::vector<ResizedMatData>& imgRDs)
+{
+	std::vector<torch::Tensor> resultOrg;
+	for (int i = 0; i < result.size(); i++)
+	{
+
+		torch::Tensor data = result[i];
+		ResizedMatData imgRD = imgRDs[i];
+		for (int j = 0; j < data.size(0); j++)
+		{
+			torch::Tensor tensor = data.select(0, j);
+			// (left, top, right, bottom)
+			if (imgRD.isSmallerWidth())
+			{
+				tensor[1] -= imgRD.getBorder();
+				tensor[3] -= imgRD.getBorder();
+				tensor[0] *= (float)imgRD.getOriginalWidth() / (float)imgRD.getWidth();
+				tensor[2] *= (float)imgRD.getOriginalWidth() / (float)imgRD.getWidth();
+				tensor[1] *= (float)imgRD.getOriginalHeight() / (float)(imgRD.getHeight() - 2 * imgRD.getBorder());
+				tensor[3] *= (float)imgRD.getOriginalHeight() / (float)(imgRD.getHeight() - 2 * imgRD.getBorder());
+			}
+			else
+			{
+				tensor[0] -= imgRD.getBorder();
+				tensor[2] -= imgRD.getBorder();
+				tensor[1] *= (float)imgRD.getOriginalHeight() / (float)imgRD.getHeight();
+				tensor[3] *= (float)imgRD.getOriginalHeight() / (float)imgRD.getHeight();
+				tensor[0] *= (float)imgRD.getOriginalWidth() / (float)(imgRD.getWidth() - 2 * imgRD.getBorder());
+				tensor[2] *= (float)imgRD.getOriginalWidth() / (float)(imgRD.getWidth() - 2 * imgRD.getBorder());
+			}
+			// eliminate the negative number causing by the prediction result on the black border
+			for (int k = 0; k < 4; k++)
+			{
+				if (tensor[k].item().toFloat() < 0)
+				{
+					tensor[k] = 0;
+				}
+			}
+		}
+
+		resultOrg.push_back(data);
+	}
+	return resultOrg;
+}
+
+std::vector<torch::Tensor> YoloV5Reference::non_max_suppression(const torch::Tensor& prediction, float confThres, float iouThres)
+{
+	torch::Tensor xc = prediction.select(2, 4) > confThres;
+	int maxWh = 4096;
+	int maxNms = 30000;
+	std::vector<torch::Tensor> output;
+	for (int i = 0; i < prediction.size(0); i++)
+	{
+		output.push_back(torch::zeros({ 0, 6 }));
+	}
+	for (int i = 0; i < prediction.size(0); i++)
+	{
+		torch::Tensor x = prediction[i];
+		x = x.index_select(0, torch::nonzero(xc[i]).select(1, 0));
+		if (x.size(0) == 0) continue;
+
+		x.slice(1, 5, x.size(1)).mul_(x.slice(1, 4, 5));
+		torch::Tensor box = xywh2xyxy(x.slice(1, 0, 4));
+		std::tuple<torch::Tensor, torch::Tensor> max_tuple = torch::max(x.slice(1, 5, x.size(1)), 1, true);
+		x = torch::cat({ box, std::get<0>(max_tuple), std::get<1>(max_tuple) }, 1);
+		x = x.index_select(0, torch::nonzero(std::get<0>(max_tuple) > confThres).select(1, 0));
+		int n = x.size(0);
+		if (n == 0)
+		{
+			continue;
+		}
+		else if (n > maxNms)
+		{
+			x = x.index_select(0, x.select(1, 4).argsort(0, true).slice(0, 0, maxNms));
+		}
+		torch::Tensor c = x.slice(1, 5, 6) * maxWh;
+		torch::Tensor boxes = x.slice(1, 0, 4) + c;
+		torch::Tensor scores = x.select(1, 4);
+		torch::Tensor ix = nms(boxes, scores, iouThres).to(x.device());
+		output[i] = x.index_select(0, ix).cpu();
+	}
+	return output;
+}
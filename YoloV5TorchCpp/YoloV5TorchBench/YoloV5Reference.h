@@ -0,0 +1,38 @@
+﻿#pragma once
+#ifndef YOLOV5REFERENCE_H
+#define YOLOV5REFERENCE_H
+
+#include <torch/torch.h>
+#include "ResizedMatData.h"
+
+/**
+ * YoloV5Reference (the original pipeline stages, kept unchanged as the reference of the optimized ones)
+ */
+class YoloV5Reference
+{
+public:
+	// letterbox with cv::copyMakeBorder
+	static ResizedMatData resize(const cv::Mat& mat, int height, int width);
+
+	// bgr or gray to rgb cv mat
+	static cv::Mat img2RGB(const cv::Mat& img);
+
+	// rgb cv mat of height x width to Tensor (1, rgb, height, width)
+	static torch::Tensor img2Tensor(const cv::Mat& img, int height, int width);
+
+	// (center_x center_y w h) to (left, top, right, bottom)
+	static torch::Tensor xywh2xyxy(const torch::Tensor& x);
+
+	// non maximum suppression with one tensor round trip for each kept box
+	static torch::Tensor nms(const torch::Tensor& bboxes, const torch::Tensor& scores, float thresh);
+
+	// resize back the prediction result to the orignal size, element by element
+	static std::vector<torch::Tensor> sizeOriginal(const std::vector<torch::Tensor>& result,
+		const std::vector<ResizedMatData>& imgRDs);
+
+	// non maximum suppression without filter
+	static std::vector<torch::Tensor> non_max_suppression(const torch::Tensor& preds,
+		float confThres = 0.25, float iouThres = 0.45);
+};
+
+#endif // !YOLOV5REFERENCE_H
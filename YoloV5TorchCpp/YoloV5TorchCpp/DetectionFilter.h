@@ -0,0 +1,29 @@
+﻿#pragma once
+#ifndef DETECTIONFILTER_H
+#define DETECTIONFILTER_H
+
+#include <vector>
+#include <map>
+
+/**
+ * DetectionFilter (filter applied while decoding the model output, before non maximum suppression)
+ */
+struct DetectionFilter
+{
+	// class indices to keep (empty to keep every class)
+	std::vector<int> classes;
+
+	// confidence threshold of a class index (classes not listed use confThres)
+	std::map<int, float> classThres;
+
+	// suppress overlapping boxes across classes instead of per class
+	bool agnostic = false;
+
+	// maximum boxes sorted into non maximum suppression
+	int maxCandidates = 30000;
+
+	// maximum boxes kept after non maximum suppression (<= 0 for no limit)
+	int maxDetections = 0;
+};
+
+#endif // !DETECTIONFILTER_H
@@ -1,18 +1,13 @@
 ﻿#include "YoloV5.h"
+#include "YoloV5Pool.h"
+#include "YoloV5Scheduler.h"
+#include "YoloV5MultiModel.h"
+#include "YoloResult.h"
+#include "OnnxRuntimeBackend.h"
 #include <iostream>
 
 #pragma comment(linker, "/INCLUDE:?ignore_this_library_placeholder@@YAHXZ")
 
-struct YoloResult
-{
-	int ClassIndex;
-	float Confidence;
-	int X;
-	int Y;
-	int Width;
-	int Height;
-};
-
 extern "C"
 {
 	/**
@@ -71,19 +66,203 @@ extern "C"
 		return new YoloV5(buffer, isCuda, isHalf, height, width, confThres, iouThres);
 	}
 
+	/**
+	 * Constructor using a directory of frozen modules, the artifact is built on the first call
+	 * @param cacheDirectory directory of the frozen modules
+	 */
+	__declspec(dllexport) YoloV5* YoloV5NewByPathCached(const char* torchscriptPath, const char* cacheDirectory, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
+	{
+		ModuleCache cache(cacheDirectory);
+		return new YoloV5(torchscriptPath, cache, isCuda, isHalf, height, width, confThres, iouThres);
+	}
+
+#ifdef YOLOV5_WITH_ONNXRUNTIME
+	/**
+	 * YoloV5 running the forward pass on the ONNX Runtime cpu engine
+	 * @param intraOpThreads threads inside an operator (0 for the onnxruntime default)
+	 * @param optimizationLevel graph optimization 0 (none) to 3 (all)
+	 */
+	__declspec(dllexport) YoloV5* YoloV5NewByOnnx(const char* onnxPath, int intraOpThreads, int optimizationLevel, int height, int width, float confThres, float iouThres)
+	{
+		try
+		{
+			std::shared_ptr<InferenceBackend> backend = std::make_shared<OnnxRuntimeBackend>(onnxPath, intraOpThreads, 0, optimizationLevel);
+			return new YoloV5(backend, height, width, confThres, iouThres);
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5NewByOnnx Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+#endif
+
+	/**
+	 * Milliseconds spent in the constructor (loading, conversion and warm up)
+	 */
+	__declspec(dllexport) double YoloV5ColdStartMs(YoloV5* yolov5)
+	{
+		if (yolov5 == nullptr)
+			return -1;
+
+		return yolov5->getColdStartMs();
+	}
+
+	/**
+	 * Run the model in channels_last memory format with oneDNN prepacked weights on cpu
+	 * @return false if the oneDNN optimization failed
+	 */
+	__declspec(dllexport) bool YoloV5EnableChannelsLast(YoloV5* yolov5)
+	{
+		if (yolov5 == nullptr)
+			return false;
+
+		try
+		{
+			return yolov5->enableChannelsLast();
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5EnableChannelsLast Exception: " << ex.what() << std::endl;
+		}
+		return false;
+	}
+
 	__declspec(dllexport) void YoloV5Delete(YoloV5* yolov5)
 	{
 		if (yolov5 != nullptr)
 			delete yolov5;
 	}
 
+	/**
+	 * Set the filter applied before non maximum suppression
+	 * @param classes class indices to keep (nullptr or empty to keep every class)
+	 * @param thresClasses class indices having their own confidence threshold
+	 * @param thresValues confidence thresholds of thresClasses
+	 * @param agnostic suppress overlapping boxes across classes
+	 * @param maxCandidates maximum boxes sorted into non maximum suppression
+	 * @param maxDetections maximum boxes kept after non maximum suppression (<= 0 for no limit)
+	 */
+	__declspec(dllexport) void YoloV5SetFilter(YoloV5* yolov5, int* classes, int classesLength,
+		int* thresClasses, float* thresValues, int thresLength, bool agnostic, int maxCandidates, int maxDetections)
+	{
+		if (yolov5 == nullptr)
+			return;
+
+		DetectionFilter filter;
+		for (int i = 0; classes != nullptr && i < classesLength; i++)
+		{
+			filter.classes.push_back(classes[i]);
+		}
+		for (int i = 0; thresClasses != nullptr && thresValues != nullptr && i < thresLength; i++)
+		{
+			filter.classThres[thresClasses[i]] = thresValues[i];
+		}
+		filter.agnostic = agnostic;
+		filter.maxCandidates = maxCandidates;
+		filter.maxDetections = maxDetections;
+		yolov5->setFilter(filter);
+	}
+
+	/**
+	 * Cache the results of single image predictions by image content
+	 * @param byteBudget maximum bytes of the cached results (0 to disable the cache)
+	 */
+	__declspec(dllexport) void YoloV5EnableCache(YoloV5* yolov5, long long byteBudget)
+	{
+		if (yolov5 != nullptr)
+			yolov5->enableCache(byteBudget > 0 ? (size_t)byteBudget : 0);
+	}
+
+	__declspec(dllexport) bool YoloV5CacheStats(YoloV5* yolov5, long long* hits, long long* misses, long long* evictions, long long* bytes)
+	{
+		if (yolov5 == nullptr || yolov5->getCache() == nullptr || hits == nullptr || misses == nullptr ||
+			evictions == nullptr || bytes == nullptr)
+			return false;
+
+		ResultCache* cache = yolov5->getCache();
+		*hits = cache->getHits();
+		*misses = cache->getMisses();
+		*evictions = cache->getEvictions();
+		*bytes = cache->getBytes();
+		return true;
+	}
+
+	/**
+	 * Bound the memory of the instance, batches are split to fit
+	 * @param byteBudget maximum bytes of the weights and the buffers of the running predictions (0 for no limit)
+	 */
+	__declspec(dllexport) void YoloV5SetMemoryBudget(YoloV5* yolov5, long long byteBudget)
+	{
+		if (yolov5 != nullptr)
+			yolov5->setMemoryBudget(byteBudget);
+	}
+
+	/**
+	 * Bytes accounted to the instance, the peak is the highest sum since the construction
+	 */
+	__declspec(dllexport) bool YoloV5MemoryStats(YoloV5* yolov5, long long* weights, long long* input, long long* scratch,
+		long long* candidates, long long* current, long long* peak, long long* budget)
+	{
+		if (yolov5 == nullptr || weights == nullptr || input == nullptr || scratch == nullptr || candidates == nullptr ||
+			current == nullptr || peak == nullptr || budget == nullptr)
+			return false;
+
+		MemoryAccount::Stats stats = yolov5->getMemory()->getStats();
+		*weights = stats.weights;
+		*input = stats.input;
+		*scratch = stats.scratch;
+		*candidates = stats.candidates;
+		*current = stats.current;
+		*peak = stats.peak;
+		*budget = stats.budget;
+		return true;
+	}
+
+	/**
+	 * Estimated bytes of the buffers of a batch prediction
+	 */
+	__declspec(dllexport) long long YoloV5EstimateMemory(YoloV5* yolov5, int height, int width, int channels, int batch)
+	{
+		if (yolov5 == nullptr)
+			return -1;
+
+		return yolov5->estimateBytes(height, width, channels, batch);
+	}
+
+	/**
+	 * Start recording the spans of the prediction stages
+	 * @param torchOps also record the libtorch operators
+	 */
+	__declspec(dllexport) void YoloV5TraceStart(YoloV5* yolov5, bool torchOps)
+	{
+		if (yolov5 != nullptr)
+			yolov5->startTrace(torchOps);
+	}
+
+	/**
+	 * Stop recording and write the spans as a Chrome trace json file
+	 * @param path json path
+	 * @return false if the file cannot be written
+	 */
+	__declspec(dllexport) bool YoloV5TraceStop(YoloV5* yolov5, const char* path)
+	{
+		if (yolov5 == nullptr || path == nullptr)
+			return false;
+
+		return yolov5->stopTrace(path);
+	}
+
 	/*
 	* Tensor result to YoloResults
 	* @param tensorResult tensor detection result
+	* @param tracer tracer of the export stage (may be null)
 	* @return need to be deleted, vector is created by new
 	*/
-	std::vector<YoloResult>* TensorToYoloResults(const torch::Tensor& tensorResult)
+	std::vector<YoloResult>* TensorToYoloResults(const torch::Tensor& tensorResult, Tracer* tracer = nullptr)
 	{
+		TraceSpan span(tracer, "export");
+		span.arg("detections", tensorResult.size(0));
 		std::vector<YoloResult>* result = new std::vector<YoloResult>();
 		for (int i = 0; i < tensorResult.size(0); i++)
 		{
@@ -114,7 +293,7 @@ extern "C"
 		{
 			auto prediction = yolov5->prediction(*mat);
 			torch::Tensor predictionResult = prediction[0];
-			std::vector<YoloResult>* result = TensorToYoloResults(predictionResult);
+			std::vector<YoloResult>* result = TensorToYoloResults(predictionResult, yolov5->getTracer());
 			return result;
 		}
 		catch (std::exception& ex)
@@ -124,6 +303,127 @@ extern "C"
 		return nullptr;
 	}
 
+	/**
+	 * Predict from caller memory without copying it
+	 * @param data first pixel of the image (or of the region of interest)
+	 * @param stride bytes between the starts of two rows (not negative, the wrapper rejects bottom-up rows)
+	 * @param pixelFormat PixelFormat (0: BGR, 1: RGB, 2: BGRA, 3: GRAY, 4: NV12)
+	 */
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5PreditctFromBuffer(YoloV5* yolov5, uint8_t* data, int width, int height, int stride, int pixelFormat)
+	{
+		if (yolov5 == nullptr || data == nullptr)
+			return nullptr;
+
+		try
+		{
+			ImageDescriptor image;
+			image.data = data;
+			image.width = width;
+			image.height = height;
+			image.stride = stride;
+			image.format = (PixelFormat)pixelFormat;
+			auto prediction = yolov5->prediction(image);
+			return TensorToYoloResults(prediction[0], yolov5->getTracer());
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PreditctFromBuffer Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Predict only regions of interest of an image
+	 * @param rects (x, y, width, height) of each region
+	 * @param roiCount number of regions (0 for the whole image)
+	 */
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5PreditctRois(YoloV5* yolov5, cv::Mat* mat, int* rects, int roiCount)
+	{
+		if (yolov5 == nullptr || mat == nullptr || (rects == nullptr && roiCount > 0))
+			return nullptr;
+
+		try
+		{
+			std::vector<cv::Rect> rois;
+			for (int i = 0; i < roiCount; i++)
+			{
+				rois.emplace_back(rects[i * 4], rects[i * 4 + 1], rects[i * 4 + 2], rects[i * 4 + 3]);
+			}
+			auto prediction = yolov5->prediction(*mat, rois);
+			return TensorToYoloResults(prediction[0], yolov5->getTracer());
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PreditctRois Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Predict only the regions of a mask (bounding rectangles of its connected components)
+	 * @param mask mask of the image, non zero pixels are of interest
+	 * @param minArea smallest component kept in pixels
+	 */
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5PreditctMask(YoloV5* yolov5, cv::Mat* mat, cv::Mat* mask, int minArea)
+	{
+		if (yolov5 == nullptr || mat == nullptr || mask == nullptr)
+			return nullptr;
+
+		try
+		{
+			std::vector<cv::Rect> rois = YoloV5::maskRois(*mask, minArea);
+			if (rois.empty())
+				return new std::vector<YoloResult>();
+
+			auto prediction = yolov5->prediction(*mat, rois);
+			return TensorToYoloResults(prediction[0], yolov5->getTracer());
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PreditctMask Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5PreditctWithSize(YoloV5* yolov5, cv::Mat* mat, int height, int width)
+	{
+		if (yolov5 == nullptr || mat == nullptr)
+			return nullptr;
+
+		try
+		{
+			auto prediction = yolov5->prediction(*mat, height, width);
+			return TensorToYoloResults(prediction[0], yolov5->getTracer());
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PreditctWithSize Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) bool YoloV5WarmUp(YoloV5* yolov5, int* heights, int* widths, int length, int iterations)
+	{
+		if (yolov5 == nullptr || heights == nullptr || widths == nullptr)
+			return false;
+
+		try
+		{
+			std::vector<cv::Size> sizes;
+			for (int i = 0; i < length; i++)
+			{
+				sizes.emplace_back(widths[i], heights[i]);
+			}
+			yolov5->warmUp(sizes, iterations);
+			return true;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5WarmUp Exception: " << ex.what() << std::endl;
+		}
+		return false;
+	}
+
 	__declspec(dllexport) std::vector<std::vector<YoloResult>*>* YoloV5Preditcts(YoloV5* yolov5, cv::Mat** matArr, int matArrLength)
 	{
 		if (yolov5 == nullptr || matArr == nullptr || matArrLength <= 0)
@@ -146,7 +446,7 @@ extern "C"
 			for (int i = 0; i < mats.size(); i++)
 			{
 				torch::Tensor predictionResult = prediction[i];
-				std::vector<YoloResult>* result = TensorToYoloResults(predictionResult);
+				std::vector<YoloResult>* result = TensorToYoloResults(predictionResult, yolov5->getTracer());
 				results->emplace_back(result);
 			}
 			return results;
@@ -158,6 +458,254 @@ extern "C"
 		return nullptr;
 	}
 
+	__declspec(dllexport) std::vector<std::vector<YoloResult>*>* YoloV5PreditctsMosaic(YoloV5* yolov5, cv::Mat** matArr, int matArrLength, int gutter, float minScale)
+	{
+		if (yolov5 == nullptr || matArr == nullptr || matArrLength <= 0)
+			return nullptr;
+
+		try
+		{
+			std::vector<cv::Mat> mats;
+			for (int i = 0; i < matArrLength; i++)
+			{
+				cv::Mat* matPtr = matArr[i];
+				if (matPtr == nullptr)
+					return nullptr;
+				mats.emplace_back(*matPtr);
+			}
+
+			cv::Size inputSize = yolov5->getInputSize();
+			MosaicPacker packer(inputSize.height, inputSize.width, gutter, minScale);
+			auto prediction = yolov5->prediction(mats, packer);
+			auto results = new std::vector<std::vector<YoloResult>*>();
+
+			for (int i = 0; i < mats.size(); i++)
+			{
+				results->emplace_back(TensorToYoloResults(prediction[i], yolov5->getTracer()));
+			}
+			return results;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PreditctsMosaic Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) YoloV5Pool* YoloV5PoolNewByPath(const char* torchscriptPath, int replicas, int threadsPerReplica, bool pinCores, int height, int width, float confThres, float iouThres)
+	{
+		return new YoloV5Pool(torchscriptPath, replicas, threadsPerReplica, pinCores, height, width, confThres, iouThres);
+	}
+
+	__declspec(dllexport) void YoloV5PoolDelete(YoloV5Pool* pool)
+	{
+		if (pool != nullptr)
+			delete pool;
+	}
+
+	/**
+	 * Search (replicas x threads) of the pool for the maximum throughput
+	 * @return throughput (images per second) of the chosen configuration, negative on failure
+	 */
+	__declspec(dllexport) double YoloV5PoolAutoTune(YoloV5Pool* pool, cv::Mat* sample, float latencySloMs, int requests, int* replicas, int* threadsPerReplica)
+	{
+		if (pool == nullptr || sample == nullptr || replicas == nullptr || threadsPerReplica == nullptr)
+			return -1;
+
+		try
+		{
+			double throughput = pool->autoTune(*sample, latencySloMs, requests);
+			*replicas = pool->getReplicas();
+			*threadsPerReplica = pool->getThreadsPerReplica();
+			return throughput;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PoolAutoTune Exception: " << ex.what() << std::endl;
+		}
+		return -1;
+	}
+
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5PoolPreditct(YoloV5Pool* pool, cv::Mat* mat)
+	{
+		if (pool == nullptr || mat == nullptr)
+			return nullptr;
+
+		try
+		{
+			auto prediction = pool->prediction(*mat);
+			return TensorToYoloResults(prediction[0]);
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PoolPreditct Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) std::vector<std::vector<YoloResult>*>* YoloV5PoolPreditcts(YoloV5Pool* pool, cv::Mat** matArr, int matArrLength)
+	{
+		if (pool == nullptr || matArr == nullptr || matArrLength <= 0)
+			return nullptr;
+
+		try
+		{
+			std::vector<cv::Mat> mats;
+			for (int i = 0; i < matArrLength; i++)
+			{
+				cv::Mat* matPtr = matArr[i];
+				if (matPtr == nullptr)
+					return nullptr;
+				mats.emplace_back(*matPtr);
+			}
+
+			auto prediction = pool->prediction(mats);
+			auto results = new std::vector<std::vector<YoloResult>*>();
+			for (int i = 0; i < prediction.size(); i++)
+			{
+				results->emplace_back(TensorToYoloResults(prediction[i]));
+			}
+			return results;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5PoolPreditcts Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) YoloV5Scheduler* YoloV5SchedulerNew(YoloV5* yolov5, int downgradeHeight, int downgradeWidth, int maxQueue)
+	{
+		if (yolov5 == nullptr)
+			return nullptr;
+		return new YoloV5Scheduler(yolov5, downgradeHeight, downgradeWidth, maxQueue);
+	}
+
+	__declspec(dllexport) void YoloV5SchedulerDelete(YoloV5Scheduler* scheduler)
+	{
+		if (scheduler != nullptr)
+			delete scheduler;
+	}
+
+	/**
+	 * Predict through the deadline aware scheduler (blocks until served or shed)
+	 * @param status YoloV5ScheduleStatus of the request
+	 * @return nullptr when the request is shed
+	 */
+	__declspec(dllexport) std::vector<YoloResult>* YoloV5SchedulerPreditct(YoloV5Scheduler* scheduler, int streamId, cv::Mat* mat, float deadlineMs, int* status)
+	{
+		if (scheduler == nullptr || mat == nullptr || status == nullptr)
+			return nullptr;
+
+		try
+		{
+			YoloV5ScheduledResult scheduled = scheduler->prediction(streamId, *mat, deadlineMs);
+			*status = (int)scheduled.status;
+			if (scheduled.result.empty())
+				return nullptr;
+			return TensorToYoloResults(scheduled.result[0]);
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5SchedulerPreditct Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
+	__declspec(dllexport) void YoloV5SchedulerEnableAdaptiveResolution(YoloV5Scheduler* scheduler, int* heights, int* widths, int length,
+		float highLatencyMs, float lowLatencyMs)
+	{
+		if (scheduler == nullptr || heights == nullptr || widths == nullptr || length <= 0)
+			return;
+
+		try
+		{
+			std::vector<cv::Size> sizes;
+			for (int i = 0; i < length; i++)
+			{
+				sizes.emplace_back(widths[i], heights[i]);
+			}
+			scheduler->enableAdaptiveResolution(sizes, highLatencyMs, lowLatencyMs);
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5SchedulerEnableAdaptiveResolution Exception: " << ex.what() << std::endl;
+		}
+	}
+
+	__declspec(dllexport) void YoloV5SchedulerStats(YoloV5Scheduler* scheduler, long long* completed, long long* downgraded,
+		long long* expired, long long* superseded, long long* dropped)
+	{
+		if (scheduler == nullptr || completed == nullptr || downgraded == nullptr || expired == nullptr ||
+			superseded == nullptr || dropped == nullptr)
+			return;
+
+		try
+		{
+			*completed = scheduler->getCompleted();
+			*downgraded = scheduler->getDowngraded();
+			*expired = scheduler->getExpired();
+			*superseded = scheduler->getSuperseded();
+			*dropped = scheduler->getDropped();
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5SchedulerStats Exception: " << ex.what() << std::endl;
+		}
+	}
+
+	/**
+	 * Create a runner predicting frames with several models
+	 * @param models models to run, must outlive the runner
+	 * @param concurrent run the models on separate threads
+	 */
+	__declspec(dllexport) YoloV5MultiModel* YoloV5MultiModelNew(YoloV5** models, int modelsLength, bool concurrent)
+	{
+		if (models == nullptr || modelsLength <= 0)
+			return nullptr;
+
+		std::vector<YoloV5*> modelVector;
+		for (int i = 0; i < modelsLength; i++)
+		{
+			if (models[i] == nullptr)
+				return nullptr;
+			modelVector.push_back(models[i]);
+		}
+		return new YoloV5MultiModel(modelVector, concurrent);
+	}
+
+	__declspec(dllexport) void YoloV5MultiModelDelete(YoloV5MultiModel* multiModel)
+	{
+		if (multiModel != nullptr)
+			delete multiModel;
+	}
+
+	/**
+	 * Predict a frame with every model of the runner
+	 * @return prediction result of each model, in the order of the models
+	 */
+	__declspec(dllexport) std::vector<std::vector<YoloResult>*>* YoloV5MultiModelPreditct(YoloV5MultiModel* multiModel, cv::Mat* mat)
+	{
+		if (multiModel == nullptr || mat == nullptr)
+			return nullptr;
+
+		try
+		{
+			auto prediction = multiModel->prediction(*mat);
+			auto results = new std::vector<std::vector<YoloResult>*>();
+			for (int i = 0; i < prediction.size(); i++)
+			{
+				results->emplace_back(TensorToYoloResults(prediction[i]));
+			}
+			return results;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << "YoloV5MultiModelPreditct Exception: " << ex.what() << std::endl;
+		}
+		return nullptr;
+	}
+
 	__declspec(dllexport) int YoloV5ResultSize(std::vector<YoloResult>* result)
 	{
 		return result->size();
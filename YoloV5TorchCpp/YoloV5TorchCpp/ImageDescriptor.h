@@ -0,0 +1,41 @@
+﻿#pragma once
+#ifndef IMAGEDESCRIPTOR_H
+#define IMAGEDESCRIPTOR_H
+
+#include <cstdint>
+
+/**
+ * Pixel format of caller owned image memory
+ */
+enum class PixelFormat
+{
+	BGR = 0,
+	RGB = 1,
+	BGRA = 2,
+	GRAY = 3,
+	// Y plane followed by the interleaved UV plane, both with the same stride
+	NV12 = 4
+};
+
+/**
+ * ImageDescriptor (caller owned image memory read in place by the preprocessing)
+ */
+struct ImageDescriptor
+{
+	// first pixel of the image (or of the region of interest)
+	const uint8_t* data;
+
+	// image width in pixels
+	int width;
+
+	// image height in pixels
+	int height;
+
+	// bytes between the starts of two rows (rows top-down, a negative stride is rejected)
+	int stride;
+
+	// pixel format
+	PixelFormat format;
+};
+
+#endif // !IMAGEDESCRIPTOR_H
@@ -0,0 +1,38 @@
+﻿#pragma once
+#ifndef INFERENCEBACKEND_H
+#define INFERENCEBACKEND_H
+
+#include <torch/torch.h>
+#include <string>
+
+/**
+ * InferenceBackend (engine running the forward pass of YoloV5)
+ * The letterbox, non maximum suppression and rescaling of YoloV5 are shared by every backend,
+ * a backend only turns the input batch into the raw detections.
+ */
+class InferenceBackend
+{
+public:
+	virtual ~InferenceBackend() {}
+
+	/**
+	 * Forward pass
+	 * @param input input batch (batch, rgb, height, width) on the device and precision of the backend
+	 * @return raw detections (batch, boxes, 5 + classes) as (center_x center_y w h conf class scores...)
+	 */
+	virtual torch::Tensor forward(const torch::Tensor& input) = 0;
+
+	// get the engine name
+	virtual std::string getName() = 0;
+
+	// is the input expected on cuda
+	virtual bool isCuda() = 0;
+
+	// is the input expected in half precision
+	virtual bool isHalf() = 0;
+
+	// get the bytes of the weights held by the engine
+	virtual int64_t getWeightBytes() = 0;
+};
+
+#endif // !INFERENCEBACKEND_H
@@ -0,0 +1,67 @@
+﻿#include "MemoryAccount.h"
+
+MemoryAccount::MemoryAccount()
+{
+	for (int i = 0; i < 4; i++)
+	{
+		bytes[i] = 0;
+	}
+	current = 0;
+	peak = 0;
+	budget = 0;
+}
+
+void MemoryAccount::charge(Category category, int64_t bytes)
+{
+	this->bytes[category] += bytes;
+	int64_t total = current += bytes;
+	int64_t highest = peak.load();
+	while (total > highest && !peak.compare_exchange_weak(highest, total))
+	{
+	}
+}
+
+void MemoryAccount::setWeights(int64_t bytes)
+{
+	charge(WEIGHTS, bytes - this->bytes[WEIGHTS].load());
+}
+
+void MemoryAccount::setBudget(int64_t bytes)
+{
+	budget = bytes > 0 ? bytes : 0;
+}
+
+int64_t MemoryAccount::getBudget()
+{
+	return budget;
+}
+
+int64_t MemoryAccount::getAvailable()
+{
+	int64_t limit = budget;
+	if (limit == 0)
+	{
+		return -1;
+	}
+	// the buffers charged by concurrent predictions are not available either
+	int64_t available = limit - current;
+	return available > 0 ? available : 0;
+}
+
+MemoryAccount::Stats MemoryAccount::getStats()
+{
+	Stats stats;
+	stats.weights = bytes[WEIGHTS];
+	stats.input = bytes[INPUT];
+	stats.scratch = bytes[SCRATCH];
+	stats.candidates = bytes[CANDIDATES];
+	stats.current = current;
+	stats.peak = peak;
+	stats.budget = budget;
+	return stats;
+}
+
+void MemoryAccount::resetPeak()
+{
+	peak = current.load();
+}
@@ -0,0 +1,129 @@
+﻿#pragma once
+#ifndef MEMORYACCOUNT_H
+#define MEMORYACCOUNT_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * MemoryAccount (bytes held by one YoloV5 instance, by use, with the peak and an optional budget)
+ * Weights are set once, the input, scratch and candidate buffers are charged while they are alive.
+ * Activations inside the engine are not seen by the account.
+ */
+class MemoryAccount
+{
+public:
+	// use of the accounted bytes
+	enum Category
+	{
+		// model weights
+		WEIGHTS = 0,
+		// letterboxed images and input tensors
+		INPUT = 1,
+		// raw model output
+		SCRATCH = 2,
+		// decoded boxes of non maximum suppression
+		CANDIDATES = 3
+	};
+
+	// snapshot of the account
+	struct Stats
+	{
+		int64_t weights;
+		int64_t input;
+		int64_t scratch;
+		int64_t candidates;
+		// sum of the categories
+		int64_t current;
+		// highest sum since the construction or the last resetPeak
+		int64_t peak;
+		// 0 when unlimited
+		int64_t budget;
+	};
+
+	// Constructor, nothing accounted and no budget
+	MemoryAccount();
+
+	/**
+	 * Add bytes to a category
+	 * @param category use of the bytes
+	 * @param bytes bytes (negative to release)
+	 */
+	void charge(Category category, int64_t bytes);
+
+	/**
+	 * Set the bytes of the model weights
+	 * @param bytes weight bytes
+	 */
+	void setWeights(int64_t bytes);
+
+	/**
+	 * Set the budget of the instance
+	 * @param bytes maximum bytes of the weights and the buffers of the running predictions (0 for no limit)
+	 */
+	void setBudget(int64_t bytes);
+
+	// get the budget (0 when unlimited)
+	int64_t getBudget();
+
+	// get bytes left beside the weights and the buffers of the running predictions (-1 when unlimited)
+	int64_t getAvailable();
+
+	// get a snapshot of the account
+	Stats getStats();
+
+	// set the peak to the current bytes
+	void resetPeak();
+
+private:
+	std::atomic<int64_t> bytes[4];
+	std::atomic<int64_t> current;
+	std::atomic<int64_t> peak;
+	std::atomic<int64_t> budget;
+};
+
+/**
+ * MemoryCharge (charges bytes from its construction to its destruction)
+ */
+class MemoryCharge
+{
+public:
+	/**
+	 * Constructor
+	 * @param account account to charge (may be null)
+	 * @param category use of the bytes
+	 * @param bytes bytes held until the destruction
+	 */
+	MemoryCharge(MemoryAccount* account, MemoryAccount::Category category, int64_t bytes)
+	{
+		this->account = account;
+		this->category = category;
+		this->bytes = 0;
+		add(bytes);
+	}
+
+	~MemoryCharge()
+	{
+		add(-bytes);
+	}
+
+	/**
+	 * Charge more bytes until the destruction
+	 * @param bytes bytes (negative to release early)
+	 */
+	void add(int64_t bytes)
+	{
+		if (account != nullptr && bytes != 0)
+		{
+			account->charge(category, bytes);
+			this->bytes += bytes;
+		}
+	}
+
+private:
+	MemoryAccount* account;
+	MemoryAccount::Category category;
+	int64_t bytes;
+};
+
+#endif // !MEMORYACCOUNT_H
@@ -0,0 +1,253 @@
+﻿#include "ModuleCache.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+ModuleCache::ModuleCache(const std::string& directory)
+{
+	this->directory = directory;
+	this->lastHit = false;
+	this->lastLoadMs = 0;
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+// FNV-1a over the 64 bit words of a block, the buffer has room for the zero padded tail
+static uint64_t hashWords(uint64_t hash, std::vector<char>& buffer, size_t n)
+{
+	std::memset(buffer.data() + n, 0, (8 - n % 8) % 8);
+	for (size_t i = 0; i < n; i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, buffer.data() + i, sizeof(word));
+		hash ^= word;
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+uint64_t ModuleCache::fileHash(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		throw std::runtime_error("cannot open " + path);
+	}
+	uint64_t hash = 0xCBF29CE484222325ull;
+	std::vector<char> buffer(1 << 20);
+	while (file)
+	{
+		file.read(buffer.data(), buffer.size());
+		hash = hashWords(hash, buffer, (size_t)file.gcount());
+	}
+	return hash;
+}
+
+std::string ModuleCache::fileSample(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		throw std::runtime_error("cannot open " + path);
+	}
+	int64_t size = (int64_t)file.tellg();
+	int64_t block = 1 << 20;
+	std::vector<char> buffer((size_t)block);
+	uint64_t hash = 0xCBF29CE484222325ull ^ (uint64_t)size;
+	// the first block holds the code of the archive, the last one its central directory
+	// with the crc32 of every entry, weights included
+	int64_t offsets[2] = { 0, std::max<int64_t>(0, size - block) };
+	for (int i = 0; i < 2; i++)
+	{
+		file.clear();
+		file.seekg(offsets[i]);
+		file.read(buffer.data(), std::min(block, size - offsets[i]));
+		hash = hashWords(hash, buffer, (size_t)file.gcount());
+	}
+	char sample[40];
+	std::snprintf(sample, sizeof(sample), "%llx_%016llx", (unsigned long long)size, (unsigned long long)hash);
+	return sample;
+}
+
+std::string ModuleCache::key(const std::string& torchScriptPath, bool isCuda, bool isHalf, int height, int width)
+{
+	// size and hash of the first and last blocks, at most 2 MiB of the file are read
+	std::ostringstream oss;
+	oss << fileSample(torchScriptPath) << "_torch" << TORCH_VERSION_MAJOR << "." << TORCH_VERSION_MINOR << "." << TORCH_VERSION_PATCH
+		<< "_" << (isCuda ? "cuda" : "cpu") << "_" << (isHalf ? "half" : "float") << "_" << height << "x" << width;
+	return oss.str();
+}
+
+std::string ModuleCache::modulePath(const std::string& key)
+{
+	return directory + "/" + key + ".pt";
+}
+
+std::string ModuleCache::frozenPath(const std::string& key)
+{
+	return directory + "/" + key + ".frozen.pt";
+}
+
+std::string ModuleCache::hashPath(const std::string& key)
+{
+	return directory + "/" + key + ".hash";
+}
+
+std::string ModuleCache::resolutionsPath(const std::string& key)
+{
+	return directory + "/" + key + ".txt";
+}
+
+torch::jit::script::Module ModuleCache::load(const std::string& torchScriptPath, bool isCuda, bool isHalf,
+	int height, int width, std::vector<cv::Size>& resolutions)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::string name = key(torchScriptPath, isCuda, isHalf, height, width);
+	lastKey = name;
+	torch::Device device = isCuda ? torch::kCUDA : torch::kCPU;
+
+	resolutions.clear();
+	std::ifstream shapes(resolutionsPath(name));
+	int h, w;
+	while (shapes >> h >> w)
+	{
+		resolutions.emplace_back(w, h);
+	}
+	if (resolutions.empty())
+	{
+		resolutions.emplace_back(width, height);
+	}
+
+	// oneDNN prepacking only applies to float modules on cpu
+	bool optimizable = !isCuda && !isHalf;
+	torch::jit::script::Module model;
+	lastHit = std::ifstream(modulePath(name), std::ios::binary).good();
+	if (lastHit)
+	{
+		model = torch::jit::load(modulePath(name), device);
+	}
+	else if (std::ifstream(frozenPath(name), std::ios::binary).good())
+	{
+		// the optimized graph could not be saved, only the optimization is paid again
+		lastHit = true;
+		model = torch::jit::load(frozenPath(name), device);
+		model = optimize(model);
+	}
+	else
+	{
+		// full content hash of the source, kept to verify the artifact
+		std::ofstream hash(hashPath(name), std::ios::trunc);
+		hash << std::hex << fileHash(torchScriptPath) << "\n";
+		model = freezeFile(torchScriptPath, device, isHalf);
+		if (!optimizable)
+		{
+			save(model, modulePath(name));
+		}
+		else
+		{
+			model = optimize(model);
+			if (!save(model, modulePath(name)))
+			{
+				// the graph is optimized in place, so the frozen fallback is built again
+				save(freezeFile(torchScriptPath, device, isHalf), frozenPath(name));
+			}
+		}
+	}
+	lastLoadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	return model;
+}
+
+torch::jit::script::Module ModuleCache::freezeFile(const std::string& torchScriptPath, torch::Device device, bool isHalf)
+{
+	torch::jit::script::Module model = torch::jit::load(torchScriptPath, device);
+	if (isHalf)
+	{
+		model.to(torch::kHalf);
+	}
+	model.eval();
+	// parameters become constants and conv + batchnorm are folded
+	return torch::jit::freeze(model);
+}
+
+torch::jit::script::Module ModuleCache::optimize(torch::jit::script::Module& model)
+{
+	try
+	{
+		// convolutions become prepacked oneDNN ops fused with their activations
+		return torch::jit::optimize_for_inference(model);
+	}
+	catch (const std::exception&)
+	{
+		return model;
+	}
+}
+
+bool ModuleCache::save(const torch::jit::script::Module& model, const std::string& path)
+{
+	// written aside and renamed so that a concurrent load never reads a partial artifact
+	std::string temporary = path + ".tmp";
+	try
+	{
+		model.save(temporary);
+	}
+	catch (const std::exception&)
+	{
+		// oneDNN tensor constants of an optimized graph cannot be pickled by every libtorch
+		std::remove(temporary.c_str());
+		return false;
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::remove(temporary.c_str());
+		// renaming over an existing file fails on windows, the artifact of a concurrent load is as good
+		return std::ifstream(path, std::ios::binary).good();
+	}
+	return true;
+}
+
+bool ModuleCache::verify(const std::string& torchScriptPath, const std::string& key)
+{
+	std::ifstream file(hashPath(key));
+	uint64_t hash;
+	return (bool)(file >> std::hex >> hash) && hash == fileHash(torchScriptPath);
+}
+
+void ModuleCache::saveResolutions(const std::string& key, const std::vector<cv::Size>& resolutions)
+{
+	std::ofstream shapes(resolutionsPath(key), std::ios::trunc);
+	for (int i = 0; i < resolutions.size(); i++)
+	{
+		shapes << resolutions[i].height << " " << resolutions[i].width << "\n";
+	}
+}
+
+std::string ModuleCache::getLastKey()
+{
+	return lastKey;
+}
+
+bool ModuleCache::getLastHit()
+{
+	return lastHit;
+}
+
+double ModuleCache::getLastLoadMs()
+{
+	return lastLoadMs;
+}
+
+std::string ModuleCache::getDirectory()
+{
+	return directory;
+}
@@ -0,0 +1,106 @@
+﻿#pragma once
+#ifndef MODULECACHE_H
+#define MODULECACHE_H
+
+#include <torch/script.h>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * ModuleCache (directory of frozen, optimized, device placed torchscript modules)
+ * An artifact is keyed by the size and a hash of the first and last blocks of the torchscript file (the
+ * central directory of the archive holds the crc32 of every entry), the libtorch version and the settings.
+ * The hash of the whole file is saved beside it, verify() compares it when a full check is wanted.
+ * Float modules on cpu are also passed through optimize_for_inference (oneDNN prepacking) before saving.
+ * The shape specializations of the profiling executor cannot be serialized, so the input resolutions
+ * are saved beside the artifact and warmed up again, which gets later constructions hot on the same
+ * shapes before the first frame without paying the conversion.
+ */
+class ModuleCache
+{
+public:
+	/**
+	 * Constructor
+	 * @param directory directory of the artifacts (created if missing)
+	 */
+	ModuleCache(const std::string& directory);
+
+	/**
+	 * Load the frozen module of a torchscript file, it is built and saved on a miss
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param isCuda is using Cuda
+	 * @param isHalf is using half precision
+	 * @param height input height
+	 * @param width input width
+	 * @param resolutions input resolutions to warm up
+	 * @return frozen module on the device and precision of the settings
+	 */
+	torch::jit::script::Module load(const std::string& torchScriptPath, bool isCuda, bool isHalf,
+		int height, int width, std::vector<cv::Size>& resolutions);
+
+	/**
+	 * Record the input resolutions to warm up of an artifact
+	 * @param key key of the artifact
+	 * @param resolutions warmed up input resolutions
+	 */
+	void saveResolutions(const std::string& key, const std::vector<cv::Size>& resolutions);
+
+	/**
+	 * Check an artifact against the content of its torchscript file (reads the whole file)
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param key key of the artifact
+	 * @return false if the content hash differs or was not saved
+	 */
+	bool verify(const std::string& torchScriptPath, const std::string& key);
+
+	/**
+	 * Key of an artifact
+	 * @return file size and sampled content hash, libtorch version and settings
+	 */
+	std::string key(const std::string& torchScriptPath, bool isCuda, bool isHalf, int height, int width);
+
+	// get the key of the last load
+	std::string getLastKey();
+
+	// get whether the last load found its artifact
+	bool getLastHit();
+
+	// get milliseconds of the last load
+	double getLastLoadMs();
+
+	// get the directory of the artifacts
+	std::string getDirectory();
+
+private:
+	std::string directory;
+	std::string lastKey;
+	bool lastHit;
+	double lastLoadMs;
+
+	// artifact paths of a key
+	std::string modulePath(const std::string& key);
+	std::string resolutionsPath(const std::string& key);
+	std::string hashPath(const std::string& key);
+
+	// frozen artifact saved when the optimized graph cannot be serialized
+	std::string frozenPath(const std::string& key);
+
+	// load, convert and freeze a torchscript file
+	static torch::jit::script::Module freezeFile(const std::string& torchScriptPath, torch::Device device, bool isHalf);
+
+	// optimize_for_inference of a frozen module (the module itself when it fails)
+	static torch::jit::script::Module optimize(torch::jit::script::Module& model);
+
+	// save a module atomically, false if it cannot be serialized or put in place
+	static bool save(const torch::jit::script::Module& model, const std::string& path);
+
+	// 64 bit FNV-1a over the words of a file
+	static uint64_t fileHash(const std::string& path);
+
+	// size and hash of the first and last blocks of a file
+	static std::string fileSample(const std::string& path);
+};
+
+#endif // !MODULECACHE_H
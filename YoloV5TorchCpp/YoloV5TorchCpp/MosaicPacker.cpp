@@ -0,0 +1,127 @@
+﻿#include "MosaicPacker.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+MosaicPacker::MosaicPacker(int height, int width, int gutter, float minScale)
+{
+	if (height <= 0 || width <= 0 || gutter < 0 || minScale <= 0 || minScale > 1)
+	{
+		throw std::invalid_argument("invalid mosaic settings");
+	}
+	this->height = height;
+	this->width = width;
+	this->gutter = gutter;
+	this->minScale = minScale;
+}
+
+float MosaicPacker::scaleOf(const cv::Size& size) const
+{
+	// a frame larger than the canvas is shrunk to fit alone
+	float scale = std::min(1.0f, std::min((float)width / size.width, (float)height / size.height));
+	int best = 1;
+	for (int cols = 1; cols * size.width * minScale <= width; cols++)
+	{
+		for (int rows = 1; rows * size.height * minScale <= height; rows++)
+		{
+			float fit = std::min((float)(width - (cols - 1) * gutter) / (cols * size.width),
+				(float)(height - (rows - 1) * gutter) / (rows * size.height));
+			fit = std::min(1.0f, fit);
+			if (fit >= minScale && (cols * rows > best || (cols * rows == best && fit > scale)))
+			{
+				best = cols * rows;
+				scale = fit;
+			}
+		}
+	}
+	return scale;
+}
+
+std::vector<MosaicPacker::Mosaic> MosaicPacker::pack(const std::vector<cv::Size>& sizes) const
+{
+	// one scale per size group
+	std::map<std::pair<int, int>, float> scales;
+	std::vector<cv::Size> tileSizes;
+	std::vector<float> tileScales;
+	for (int i = 0; i < sizes.size(); i++)
+	{
+		if (sizes[i].width <= 0 || sizes[i].height <= 0)
+		{
+			throw std::invalid_argument("empty frame in the mosaic");
+		}
+		std::pair<int, int> key(sizes[i].width, sizes[i].height);
+		if (scales.find(key) == scales.end())
+		{
+			scales[key] = scaleOf(sizes[i]);
+		}
+		float scale = scales[key];
+		tileScales.push_back(scale);
+		tileSizes.emplace_back(std::max(1, std::min(width, (int)(sizes[i].width * scale))),
+			std::max(1, std::min(height, (int)(sizes[i].height * scale))));
+	}
+
+	// tallest first keeps the frames of a size together and the shelves tight
+	std::vector<int> order(sizes.size());
+	for (int i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b)
+		{
+			if (tileSizes[a].height != tileSizes[b].height)
+			{
+				return tileSizes[a].height > tileSizes[b].height;
+			}
+			return tileSizes[a].width > tileSizes[b].width;
+		});
+
+	std::vector<Mosaic> mosaics;
+	std::vector<std::vector<Shelf>> shelves;
+	for (int i : order)
+	{
+		cv::Size tile = tileSizes[i];
+		bool placed = false;
+		// first fit on the open shelves, then on a new shelf of an open canvas, then on a new canvas
+		for (int m = 0; m < mosaics.size() && !placed; m++)
+		{
+			for (Shelf& shelf : shelves[m])
+			{
+				int x = shelf.x == 0 ? 0 : shelf.x + gutter;
+				if (tile.height <= shelf.height && x + tile.width <= width)
+				{
+					mosaics[m].tiles.push_back({ i, cv::Rect(x, shelf.y, tile.width, tile.height), tileScales[i] });
+					shelf.x = x + tile.width;
+					placed = true;
+					break;
+				}
+			}
+			if (!placed)
+			{
+				int y = shelves[m].back().y + shelves[m].back().height + gutter;
+				if (y + tile.height <= height)
+				{
+					shelves[m].push_back({ y, tile.height, tile.width });
+					mosaics[m].tiles.push_back({ i, cv::Rect(0, y, tile.width, tile.height), tileScales[i] });
+					placed = true;
+				}
+			}
+		}
+		if (!placed)
+		{
+			mosaics.push_back(Mosaic());
+			shelves.push_back({ { 0, tile.height, tile.width } });
+			mosaics.back().tiles.push_back({ i, cv::Rect(0, 0, tile.width, tile.height), tileScales[i] });
+		}
+	}
+	return mosaics;
+}
+
+cv::Size MosaicPacker::getCanvasSize() const
+{
+	return cv::Size(width, height);
+}
+
+int MosaicPacker::getGutter() const
+{
+	return gutter;
+}
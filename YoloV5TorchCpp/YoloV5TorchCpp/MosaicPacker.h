@@ -0,0 +1,80 @@
+﻿#pragma once
+#ifndef MOSAICPACKER_H
+#define MOSAICPACKER_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * MosaicPacker (tiles several small frames into model size canvases)
+ * Frames are grouped by size, each group gets the largest grid of tiles per canvas that keeps
+ * its scale above minScale, then the tiles are placed on shelves (rows of tiles) separated by gutters,
+ * so one forward pass predicts several frames instead of upscaling each of them to the input size.
+ */
+class MosaicPacker
+{
+public:
+	// frame placed on a canvas
+	struct Tile
+	{
+		// index of the frame
+		int frame;
+
+		// region of the canvas holding the frame
+		cv::Rect region;
+
+		// canvas pixels per frame pixel
+		float scale;
+	};
+
+	// canvas of the input size and its tiles
+	struct Mosaic
+	{
+		std::vector<Tile> tiles;
+	};
+
+	/**
+	 * Constructor
+	 * @param height canvas height (model input height)
+	 * @param width canvas width (model input width)
+	 * @param gutter black pixels between two tiles
+	 * @param minScale smallest scale accepted to fit more tiles on a canvas (frames never get upscaled)
+	 */
+	MosaicPacker(int height = 640, int width = 640, int gutter = 16, float minScale = 0.9f);
+
+	/**
+	 * Pack frames on canvases
+	 * @param sizes size of each frame
+	 * @return canvases, every frame is on exactly one tile
+	 */
+	std::vector<Mosaic> pack(const std::vector<cv::Size>& sizes) const;
+
+	/**
+	 * Scale of the frames of a size
+	 * @param size frame size
+	 * @return canvas pixels per frame pixel (1 when the frame fits, lower when it is larger than a canvas)
+	 */
+	float scaleOf(const cv::Size& size) const;
+
+	// get canvas size
+	cv::Size getCanvasSize() const;
+
+	// get black pixels between two tiles
+	int getGutter() const;
+
+private:
+	int height;
+	int width;
+	int gutter;
+	float minScale;
+
+	// row of tiles of a canvas
+	struct Shelf
+	{
+		int y;
+		int height;
+		int x;
+	};
+};
+
+#endif // !MOSAICPACKER_H
@@ -0,0 +1,121 @@
+﻿#include "OnnxRuntimeBackend.h"
+#include <algorithm>
+#include <fstream>
+
+#ifdef YOLOV5_WITH_ONNXRUNTIME
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// onnxruntime paths are wide strings on windows, the narrow paths of the library are in the ansi code page
+static std::basic_string<ORTCHAR_T> ortPath(const std::string& path)
+{
+#ifdef _WIN32
+	int length = MultiByteToWideChar(CP_ACP, 0, path.c_str(), (int)path.size(), nullptr, 0);
+	std::wstring wide(length, L'\0');
+	if (length > 0)
+	{
+		MultiByteToWideChar(CP_ACP, 0, path.c_str(), (int)path.size(), &wide[0], length);
+	}
+	return wide;
+#else
+	return path;
+#endif
+}
+
+OnnxRuntimeBackend::OnnxRuntimeBackend(const std::string& onnxPath, int intraOpThreads, int interOpThreads,
+	int optimizationLevel, const std::string& optimizedModelPath)
+	: env(ORT_LOGGING_LEVEL_WARNING, "YoloV5"),
+	memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault))
+{
+	Ort::SessionOptions options;
+	if (intraOpThreads > 0)
+	{
+		options.SetIntraOpNumThreads(intraOpThreads);
+	}
+	if (interOpThreads > 0)
+	{
+		options.SetInterOpNumThreads(interOpThreads);
+	}
+	options.SetExecutionMode(interOpThreads > 1 ? ExecutionMode::ORT_PARALLEL : ExecutionMode::ORT_SEQUENTIAL);
+	GraphOptimizationLevel levels[] = { GraphOptimizationLevel::ORT_DISABLE_ALL, GraphOptimizationLevel::ORT_ENABLE_BASIC,
+		GraphOptimizationLevel::ORT_ENABLE_EXTENDED, GraphOptimizationLevel::ORT_ENABLE_ALL };
+	options.SetGraphOptimizationLevel(levels[std::max(0, std::min(3, optimizationLevel))]);
+
+	std::basic_string<ORTCHAR_T> optimizedPath = ortPath(optimizedModelPath);
+	if (!optimizedModelPath.empty())
+	{
+		options.SetOptimizedModelFilePath(optimizedPath.c_str());
+	}
+	std::basic_string<ORTCHAR_T> path = ortPath(onnxPath);
+	session.reset(new Ort::Session(env, path.c_str(), options));
+
+	Ort::AllocatorWithDefaultOptions allocator;
+	inputName = session->GetInputNameAllocated(0, allocator).get();
+	outputName = session->GetOutputNameAllocated(0, allocator).get();
+	std::vector<int64_t> inputShape = session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+	staticBatch = inputShape.empty() || inputShape[0] <= 0 ? 0 : inputShape[0];
+
+	std::ifstream file(onnxPath, std::ios::binary | std::ios::ate);
+	weightBytes = file ? (int64_t)file.tellg() : 0;
+}
+
+torch::Tensor OnnxRuntimeBackend::forward(const torch::Tensor& input)
+{
+	torch::Tensor data = input.to(torch::kCPU, torch::kFloat).contiguous();
+	if (staticBatch == 0 || data.size(0) == staticBatch)
+	{
+		return run(data);
+	}
+	// an export with a fixed batch runs the batch in chunks of its size
+	if (data.size(0) % staticBatch != 0)
+	{
+		throw std::invalid_argument("batch size is not a multiple of the onnx batch size");
+	}
+	std::vector<torch::Tensor> outputs;
+	for (int64_t i = 0; i < data.size(0); i += staticBatch)
+	{
+		outputs.push_back(run(data.slice(0, i, i + staticBatch).contiguous()));
+	}
+	return torch::cat(outputs, 0);
+}
+
+torch::Tensor OnnxRuntimeBackend::run(const torch::Tensor& input)
+{
+	std::vector<int64_t> shape(input.sizes().begin(), input.sizes().end());
+	Ort::Value inputValue = Ort::Value::CreateTensor<float>(memoryInfo, input.data_ptr<float>(),
+		(size_t)input.numel(), shape.data(), shape.size());
+	const char* inputNames[] = { inputName.c_str() };
+	const char* outputNames[] = { outputName.c_str() };
+	std::vector<Ort::Value> outputs = session->Run(Ort::RunOptions{ nullptr }, inputNames, &inputValue, 1, outputNames, 1);
+
+	std::vector<int64_t> outputShape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+	// copied out because the onnxruntime buffer is released with its value
+	return torch::from_blob(outputs[0].GetTensorMutableData<float>(), outputShape, torch::kFloat).clone();
+}
+
+std::string OnnxRuntimeBackend::getName()
+{
+	return "onnxruntime";
+}
+
+bool OnnxRuntimeBackend::isCuda()
+{
+	return false;
+}
+
+bool OnnxRuntimeBackend::isHalf()
+{
+	return false;
+}
+
+int64_t OnnxRuntimeBackend::getWeightBytes()
+{
+	return weightBytes;
+}
+
+#endif // YOLOV5_WITH_ONNXRUNTIME
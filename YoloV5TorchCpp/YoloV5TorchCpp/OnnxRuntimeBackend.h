@@ -0,0 +1,59 @@
+﻿#pragma once
+#ifndef ONNXRUNTIMEBACKEND_H
+#define ONNXRUNTIMEBACKEND_H
+
+#ifdef YOLOV5_WITH_ONNXRUNTIME
+
+#include <onnxruntime_cxx_api.h>
+#include <memory>
+#include <vector>
+#include "InferenceBackend.h"
+
+/**
+ * OnnxRuntimeBackend (forward pass of an onnx export of YoloV5 on the ONNX Runtime cpu engine)
+ * Only built with YOLOV5_WITH_ONNXRUNTIME defined and onnxruntime in the include and library paths.
+ */
+class OnnxRuntimeBackend : public InferenceBackend
+{
+public:
+	/**
+	 * Constructor
+	 * @param onnxPath YoloV5 onnx path (first output is (batch, boxes, 5 + classes))
+	 * @param intraOpThreads threads inside an operator (0 for the onnxruntime default)
+	 * @param interOpThreads threads across operators, more than 1 enables the parallel executor (0 for the default)
+	 * @param optimizationLevel graph optimization 0 (none), 1 (basic), 2 (extended) or 3 (all)
+	 * @param optimizedModelPath path to save the optimized graph (empty not to save it)
+	 */
+	OnnxRuntimeBackend(const std::string& onnxPath, int intraOpThreads = 0, int interOpThreads = 0,
+		int optimizationLevel = 3, const std::string& optimizedModelPath = "");
+
+	torch::Tensor forward(const torch::Tensor& input) override;
+
+	std::string getName() override;
+
+	bool isCuda() override;
+
+	bool isHalf() override;
+
+	// bytes of the onnx file (the weights dominate it)
+	int64_t getWeightBytes() override;
+
+private:
+	Ort::Env env;
+	std::unique_ptr<Ort::Session> session;
+	Ort::MemoryInfo memoryInfo;
+	std::string inputName;
+	std::string outputName;
+
+	int64_t weightBytes;
+
+	// batch size of a static export (0 when the batch is dynamic)
+	int64_t staticBatch;
+
+	// forward pass of a batch the session accepts
+	torch::Tensor run(const torch::Tensor& input);
+};
+
+#endif // YOLOV5_WITH_ONNXRUNTIME
+
+#endif // !ONNXRUNTIMEBACKEND_H
@@ -12,32 +12,19 @@ ResizedMatData::ResizedMatData(const cv::Mat& resizedMat, int originalWidth, int
 
 ResizedMatData ResizedMatData::resize(const cv::Mat& mat, int height, int width)
 {
-	cv::Mat resized;
 	int originalWidth = mat.cols, originalHeight = mat.rows;
 
-	int w = originalWidth;
-	int h = originalHeight;
+	bool isW = (float)originalWidth / (float)originalHeight > (float)width / (float)height;
 
-	bool isW = (float)w / (float)h > (float)width / (float)height;
+	int w = isW ? width : std::max(1, (int)((float)height / (float)originalHeight * originalWidth));
+	int h = isW ? std::max(1, (int)((float)width / (float)originalWidth * originalHeight)) : height;
+	int border = isW ? (height - h) / 2 : (width - w) / 2;
 
+	// resize straight into the black letterbox canvas, the source (even a strided roi) is read in place
+	cv::Mat resized(height, width, mat.type(), cv::Scalar::all(0));
+	cv::Mat target = resized(cv::Rect(isW ? 0 : border, isW ? border : 0, w, h));
+	cv::resize(mat, target, target.size());
 
-	cv::resize(mat, resized, cv::Size(
-		isW ? width : (int)((float)height / (float)h * w),
-		isW ? (int)((float)width / (float)w * h) : height));
-
-	w = resized.cols, h = resized.rows;
-
-	int border = 0;
-	if (isW)
-	{
-		border = (height - h) / 2;
-		cv::copyMakeBorder(resized, resized, (height - h) / 2, height - h - (height - h) / 2, 0, 0, cv::BORDER_CONSTANT);
-	}
-	else
-	{
-		border = (width - w) / 2;
-		cv::copyMakeBorder(resized, resized, 0, 0, (width - w) / 2, width - w - (width - w) / 2, cv::BORDER_CONSTANT);
-	}
 	return ResizedMatData(resized, originalWidth, originalHeight, border);
 }
 
@@ -0,0 +1,48 @@
+﻿#include "ResolutionController.h"
+#include <algorithm>
+
+ResolutionController::ResolutionController(const std::vector<cv::Size>& resolutions, float highLatencyMs, float lowLatencyMs, int cooldown)
+{
+	this->resolutions = resolutions;
+	std::sort(this->resolutions.begin(), this->resolutions.end(),
+		[](const cv::Size& a, const cv::Size& b) { return a.area() > b.area(); });
+	this->current = 0;
+	this->highLatencyMs = highLatencyMs;
+	this->lowLatencyMs = lowLatencyMs;
+	this->cooldown = cooldown;
+	this->sinceChange = 0;
+	this->latencyMs = 0;
+}
+
+void ResolutionController::observe(double queueLatencyMs)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	latencyMs = latencyMs * 0.8 + queueLatencyMs * 0.2;
+	sinceChange++;
+	if (sinceChange < cooldown)
+	{
+		return;
+	}
+	if (latencyMs > highLatencyMs && current + 1 < (int)resolutions.size())
+	{
+		current++;
+		sinceChange = 0;
+	}
+	else if (latencyMs < lowLatencyMs && current > 0)
+	{
+		current--;
+		sinceChange = 0;
+	}
+}
+
+cv::Size ResolutionController::getResolution()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return resolutions.empty() ? cv::Size() : resolutions[current];
+}
+
+double ResolutionController::getLatency()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return latencyMs;
+}
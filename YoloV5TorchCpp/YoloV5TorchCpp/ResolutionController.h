@@ -0,0 +1,61 @@
+﻿#pragma once
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+#include <mutex>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * ResolutionController (chooses the input resolution from the queue latency)
+ * Steps one resolution down when the smoothed queue latency rises above highLatencyMs
+ * and one resolution up when it falls below lowLatencyMs.
+ */
+class ResolutionController
+{
+public:
+	/**
+	 * Constructor
+	 * @param resolutions available input resolutions (any order)
+	 * @param highLatencyMs queue latency to lower the resolution at
+	 * @param lowLatencyMs queue latency to raise the resolution at
+	 * @param cooldown observations to wait after a change before the next one
+	 */
+	ResolutionController(const std::vector<cv::Size>& resolutions, float highLatencyMs, float lowLatencyMs, int cooldown = 8);
+
+	/**
+	 * Feed the queue latency of a served request
+	 * @param queueLatencyMs time the request waited in the queue
+	 */
+	void observe(double queueLatencyMs);
+
+	// get current input resolution
+	cv::Size getResolution();
+
+	// get smoothed queue latency
+	double getLatency();
+
+private:
+	// input resolutions from largest to smallest
+	std::vector<cv::Size> resolutions;
+
+	// index of the current resolution
+	int current;
+
+	// thresholds of the queue latency
+	float highLatencyMs;
+	float lowLatencyMs;
+
+	// observations to wait after a change
+	int cooldown;
+
+	// observations since the last change
+	int sinceChange;
+
+	// smoothed queue latency
+	double latencyMs;
+
+	std::mutex mutex;
+};
+
+#endif // !RESOLUTIONCONTROLLER_H
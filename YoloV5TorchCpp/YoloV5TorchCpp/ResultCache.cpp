@@ -0,0 +1,218 @@
+﻿#include "ResultCache.h"
+#include <cstring>
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t round64(uint64_t lane, uint64_t value)
+{
+	lane += value * PRIME2;
+	lane = rotl(lane, 31);
+	return lane * PRIME1;
+}
+
+ResultCache::ResultCache(size_t byteBudget)
+{
+	this->byteBudget = byteBudget;
+	this->bytes = 0;
+	this->hits = 0;
+	this->misses = 0;
+	this->evictions = 0;
+}
+
+uint64_t ResultCache::combine(uint64_t seed, uint64_t value)
+{
+	return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+}
+
+void ResultCache::hashRow(const uint8_t* row, size_t length, uint64_t lanes[4])
+{
+	const uint8_t* p = row;
+	uint64_t v[4];
+	for (size_t i = 0; i < length / 32; i++, p += 32)
+	{
+		std::memcpy(v, p, 32);
+		lanes[0] = round64(lanes[0], v[0]);
+		lanes[1] = round64(lanes[1], v[1]);
+		lanes[2] = round64(lanes[2], v[2]);
+		lanes[3] = round64(lanes[3], v[3]);
+	}
+	size_t tail = length % 32;
+	if (tail > 0)
+	{
+		std::memset(v, 0, 32);
+		std::memcpy(v, p, tail);
+		lanes[0] = round64(lanes[0], v[0] ^ tail);
+		lanes[1] = round64(lanes[1], v[1]);
+		lanes[2] = round64(lanes[2], v[2]);
+		lanes[3] = round64(lanes[3], v[3]);
+	}
+}
+
+uint64_t ResultCache::fullHash(const cv::Mat& img)
+{
+	uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+	size_t rowBytes = img.cols * img.elemSize();
+	if (img.isContinuous())
+	{
+		hashRow(img.data, rowBytes * img.rows, lanes);
+	}
+	else
+	{
+		for (int r = 0; r < img.rows; r++)
+		{
+			hashRow(img.ptr(r), rowBytes, lanes);
+		}
+	}
+	uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+	hash = combine(hash, ((uint64_t)img.rows << 32) | (uint32_t)img.cols);
+	return combine(hash, img.type());
+}
+
+uint64_t ResultCache::sampledHash(const cv::Mat& img)
+{
+	const int samples = 16;
+	uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+	size_t rowBytes = img.cols * img.elemSize();
+	int n = std::min(img.rows, samples);
+	for (int i = 0; i < n; i++)
+	{
+		int r = n == 1 ? 0 : (int)((long long)i * (img.rows - 1) / (n - 1));
+		hashRow(img.ptr(r), rowBytes, lanes);
+	}
+	uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+	hash = combine(hash, ((uint64_t)img.rows << 32) | (uint32_t)img.cols);
+	return combine(hash, img.type());
+}
+
+bool ResultCache::find(uint64_t settings, const cv::Mat& img, std::vector<torch::Tensor>& result, Key& key)
+{
+	key.sampled = combine(settings, sampledHash(img));
+	key.hasFull = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (index.find(key.sampled) == index.end())
+		{
+			misses++;
+			return false;
+		}
+	}
+
+	// verify the sampled match with every pixel
+	key.full = fullHash(img);
+	key.hasFull = true;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = index.equal_range(key.sampled);
+	for (auto it = range.first; it != range.second; it++)
+	{
+		if (it->second->full == key.full)
+		{
+			entries.splice(entries.begin(), entries, it->second);
+			result.clear();
+			for (int i = 0; i < entries.front().result.size(); i++)
+			{
+				result.push_back(entries.front().result[i].clone());
+			}
+			hits++;
+			return true;
+		}
+	}
+	misses++;
+	return false;
+}
+
+void ResultCache::insert(const cv::Mat& img, const std::vector<torch::Tensor>& result, Key& key)
+{
+	if (!key.hasFull)
+	{
+		key.full = fullHash(img);
+		key.hasFull = true;
+	}
+
+	Entry entry;
+	entry.sampled = key.sampled;
+	entry.full = key.full;
+	entry.bytes = sizeof(Entry);
+	for (int i = 0; i < result.size(); i++)
+	{
+		entry.result.push_back(result[i].clone());
+		entry.bytes += result[i].numel() * result[i].element_size();
+	}
+	if (entry.bytes > byteBudget)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = index.equal_range(key.sampled);
+	for (auto it = range.first; it != range.second; it++)
+	{
+		if (it->second->full == key.full)
+		{
+			return;
+		}
+	}
+	entries.push_front(entry);
+	index.insert(std::make_pair(key.sampled, entries.begin()));
+	bytes += entry.bytes;
+
+	while (bytes > byteBudget && !entries.empty())
+	{
+		auto last = std::prev(entries.end());
+		auto range = index.equal_range(last->sampled);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			if (it->second == last)
+			{
+				index.erase(it);
+				break;
+			}
+		}
+		bytes -= last->bytes;
+		entries.erase(last);
+		evictions++;
+	}
+}
+
+void ResultCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	index.clear();
+	entries.clear();
+	bytes = 0;
+}
+
+long long ResultCache::getHits()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hits;
+}
+
+long long ResultCache::getMisses()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return misses;
+}
+
+long long ResultCache::getEvictions()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return evictions;
+}
+
+size_t ResultCache::getBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes;
+}
+
+size_t ResultCache::getByteBudget()
+{
+	return byteBudget;
+}
@@ -0,0 +1,124 @@
+﻿#pragma once
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <torch/torch.h>
+#include <opencv2/opencv.hpp>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * ResultCache (bounded LRU cache of prediction results keyed by image content)
+ * An image is looked up by a hash of a few sampled rows and verified by a hash of every pixel,
+ * so duplicated images skip the whole prediction pipeline.
+ */
+class ResultCache
+{
+public:
+	/**
+	 * Hashes of an image
+	 */
+	struct Key
+	{
+		// hash of the settings and the sampled rows
+		uint64_t sampled;
+		// hash of every pixel (valid when hasFull)
+		uint64_t full;
+		bool hasFull;
+	};
+
+	/**
+	 * Constructor
+	 * @param byteBudget maximum bytes of the cached results
+	 */
+	ResultCache(size_t byteBudget);
+
+	/**
+	 * Find the result of an image
+	 * @param settings hash of the model settings the result depends on
+	 * @param img image to find
+	 * @param result found result (copied)
+	 * @param key hashes of the image, passed to insert on a miss
+	 * @return true if found
+	 */
+	bool find(uint64_t settings, const cv::Mat& img, std::vector<torch::Tensor>& result, Key& key);
+
+	/**
+	 * Insert the result of an image, evicting the least recently used results over the budget
+	 * @param img image of the result
+	 * @param result prediction result
+	 * @param key hashes filled by find
+	 */
+	void insert(const cv::Mat& img, const std::vector<torch::Tensor>& result, Key& key);
+
+	// remove every result
+	void clear();
+
+	// get number of found results
+	long long getHits();
+
+	// get number of missing results
+	long long getMisses();
+
+	// get number of evicted results
+	long long getEvictions();
+
+	// get bytes of the cached results
+	size_t getBytes();
+
+	// get maximum bytes of the cached results
+	size_t getByteBudget();
+
+	/**
+	 * Hash of every pixel, rows are hashed 32 bytes at a time in four independent lanes
+	 * @param img image to hash
+	 * @return hash
+	 */
+	static uint64_t fullHash(const cv::Mat& img);
+
+	/**
+	 * Hash of the geometry and a few evenly spaced rows
+	 * @param img image to hash
+	 * @return hash
+	 */
+	static uint64_t sampledHash(const cv::Mat& img);
+
+	/**
+	 * Combine two hashes
+	 * @param seed hash to combine into
+	 * @param value hash to combine
+	 * @return combined hash
+	 */
+	static uint64_t combine(uint64_t seed, uint64_t value);
+
+private:
+	// cached result
+	struct Entry
+	{
+		uint64_t sampled;
+		uint64_t full;
+		std::vector<torch::Tensor> result;
+		size_t bytes;
+	};
+
+	// results from the most to the least recently used
+	std::list<Entry> entries;
+
+	// sampled hash to results
+	std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+
+	size_t byteBudget;
+	size_t bytes;
+	long long hits;
+	long long misses;
+	long long evictions;
+
+	std::mutex mutex;
+
+	// hash of a row
+	static void hashRow(const uint8_t* row, size_t length, uint64_t lanes[4]);
+};
+
+#endif // !RESULTCACHE_H
@@ -0,0 +1,85 @@
+﻿#include "TorchScriptBackend.h"
+#include <torch/csrc/jit/ir/ir.h>
+#include <torch/csrc/jit/ir/constants.h>
+
+// bytes of the tensor constants of a block and its nested blocks
+static int64_t constantBytes(torch::jit::Block* block)
+{
+	int64_t bytes = 0;
+	for (torch::jit::Node* node : block->nodes())
+	{
+		if (node->kind() == c10::prim::Constant && node->output()->type()->kind() == c10::TypeKind::TensorType)
+		{
+			c10::optional<c10::IValue> value = torch::jit::toIValue(node->output());
+			if (value && value->isTensor())
+			{
+				bytes += value->toTensor().numel() * value->toTensor().element_size();
+			}
+		}
+		for (torch::jit::Block* nested : node->blocks())
+		{
+			bytes += constantBytes(nested);
+		}
+	}
+	return bytes;
+}
+
+TorchScriptBackend::TorchScriptBackend(const torch::jit::script::Module& model, bool isCuda, bool isHalf)
+{
+	this->model = model;
+	this->cuda = isCuda;
+	this->half = isHalf;
+	if (isCuda)
+	{
+		this->model.to(torch::kCUDA);
+	}
+	if (isHalf)
+	{
+		this->model.to(torch::kHalf);
+	}
+	this->model.eval();
+}
+
+torch::Tensor TorchScriptBackend::forward(const torch::Tensor& input)
+{
+	return model.forward({ input }).toTuple()->elements()[0].toTensor();
+}
+
+std::string TorchScriptBackend::getName()
+{
+	return "torchscript";
+}
+
+bool TorchScriptBackend::isCuda()
+{
+	return cuda;
+}
+
+bool TorchScriptBackend::isHalf()
+{
+	return half;
+}
+
+int64_t TorchScriptBackend::getWeightBytes()
+{
+	int64_t bytes = 0;
+	for (const torch::Tensor& parameter : model.parameters())
+	{
+		bytes += parameter.numel() * parameter.element_size();
+	}
+	for (const torch::Tensor& buffer : model.buffers())
+	{
+		bytes += buffer.numel() * buffer.element_size();
+	}
+	// a frozen module keeps its weights as constants of the graph
+	if (bytes == 0 && model.find_method("forward"))
+	{
+		bytes = constantBytes(model.get_method("forward").graph()->block());
+	}
+	return bytes;
+}
+
+torch::jit::script::Module& TorchScriptBackend::getModule()
+{
+	return model;
+}
@@ -0,0 +1,41 @@
+﻿#pragma once
+#ifndef TORCHSCRIPTBACKEND_H
+#define TORCHSCRIPTBACKEND_H
+
+#include <torch/script.h>
+#include "InferenceBackend.h"
+
+/**
+ * TorchScriptBackend (forward pass of a torchscript module, the default backend)
+ */
+class TorchScriptBackend : public InferenceBackend
+{
+public:
+	/**
+	 * Constructor, the module is moved to the device and precision and set to evaluation
+	 * @param model loaded torchscript module
+	 * @param isCuda is using Cuda
+	 * @param isHalf is using half precision
+	 */
+	TorchScriptBackend(const torch::jit::script::Module& model, bool isCuda = false, bool isHalf = false);
+
+	torch::Tensor forward(const torch::Tensor& input) override;
+
+	std::string getName() override;
+
+	bool isCuda() override;
+
+	bool isHalf() override;
+
+	int64_t getWeightBytes() override;
+
+	// get the module (shared with the instances built from the same module)
+	torch::jit::script::Module& getModule();
+
+private:
+	torch::jit::script::Module model;
+	bool cuda;
+	bool half;
+};
+
+#endif // !TORCHSCRIPTBACKEND_H
@@ -0,0 +1,158 @@
+﻿#include "Tracer.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+std::atomic<Tracer*> Tracer::torchTracer(nullptr);
+
+// begin time of a libtorch operator
+struct OpContext : public at::ObserverContext
+{
+	int64_t beginUs;
+};
+
+// RecordFunction::name() is a StringView in older libtorch and a const char* in newer ones
+static const char* opName(const char* name)
+{
+	return name;
+}
+
+template <typename T>
+static const char* opName(const T& name)
+{
+	return name.str();
+}
+
+static std::string jsonEscape(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			escaped += ' ';
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+Tracer::Tracer()
+{
+	this->enabled = false;
+	this->torchHandle = 0;
+}
+
+Tracer::~Tracer()
+{
+	enabled = false;
+	removeTorchCallback();
+}
+
+int64_t Tracer::nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::start(bool torchOps)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		events.clear();
+	}
+	if (torchOps && torchHandle == 0)
+	{
+		Tracer* expected = nullptr;
+		if (torchTracer.compare_exchange_strong(expected, this))
+		{
+			torchHandle = at::addGlobalCallback(at::RecordFunctionCallback(onOpStart, onOpEnd));
+		}
+	}
+	enabled = true;
+}
+
+bool Tracer::stop(const std::string& path)
+{
+	enabled = false;
+	removeTorchCallback();
+
+	std::vector<Event> recorded;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		recorded.swap(events);
+	}
+
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+	file << "{\"traceEvents\":[";
+	for (size_t i = 0; i < recorded.size(); i++)
+	{
+		const Event& event = recorded[i];
+		file << (i == 0 ? "\n" : ",\n")
+			<< "{\"name\":\"" << jsonEscape(event.name) << "\",\"cat\":\"" << event.category
+			<< "\",\"ph\":\"X\",\"ts\":" << event.beginUs << ",\"dur\":" << (event.endUs - event.beginUs)
+			<< ",\"pid\":0,\"tid\":" << event.thread << ",\"args\":{" << event.args << "}}";
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return (bool)file;
+}
+
+void Tracer::record(const std::string& name, const char* category, int64_t beginUs, int64_t endUs, const std::string& args)
+{
+	Event event;
+	event.name = name;
+	event.category = category;
+	event.beginUs = beginUs;
+	event.endUs = endUs;
+	event.thread = std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000;
+	event.args = args;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	events.push_back(std::move(event));
+}
+
+void Tracer::removeTorchCallback()
+{
+	if (torchHandle != 0)
+	{
+		at::removeCallback(torchHandle);
+		torchHandle = 0;
+		torchTracer = nullptr;
+	}
+}
+
+std::unique_ptr<at::ObserverContext> Tracer::onOpStart(const at::RecordFunction& fn)
+{
+	Tracer* tracer = torchTracer.load();
+	if (tracer == nullptr || !tracer->isEnabled())
+	{
+		return nullptr;
+	}
+	std::unique_ptr<OpContext> context(new OpContext());
+	context->beginUs = nowUs();
+	return std::move(context);
+}
+
+void Tracer::onOpEnd(const at::RecordFunction& fn, at::ObserverContext* context)
+{
+	Tracer* tracer = torchTracer.load();
+	if (tracer == nullptr || context == nullptr || !tracer->isEnabled())
+	{
+		return;
+	}
+	tracer->record(opName(fn.name()), "torch", ((OpContext*)context)->beginUs, nowUs(), "");
+}
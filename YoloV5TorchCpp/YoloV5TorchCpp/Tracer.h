@@ -0,0 +1,133 @@
+﻿#pragma once
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <ATen/record_function.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Tracer (timeline of spans written as a Chrome trace / Perfetto json file)
+ * Spans are only recorded while the tracer is started, a stopped tracer costs one flag check per span.
+ */
+class Tracer
+{
+public:
+	// Constructor, the tracer starts stopped
+	Tracer();
+
+	// Destructor, stops collecting torch operators
+	~Tracer();
+
+	/**
+	 * Start recording, previous spans are discarded
+	 * @param torchOps also record the libtorch operators (one tracer at a time)
+	 */
+	void start(bool torchOps = false);
+
+	/**
+	 * Stop recording and write the spans
+	 * @param path chrome trace json path
+	 * @return false if the file cannot be written
+	 */
+	bool stop(const std::string& path);
+
+	// is recording
+	bool isEnabled()
+	{
+		return enabled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Record a span
+	 * @param name span name
+	 * @param category span category
+	 * @param beginUs begin time in microseconds
+	 * @param endUs end time in microseconds
+	 * @param args json members of the span arguments (without braces)
+	 */
+	void record(const std::string& name, const char* category, int64_t beginUs, int64_t endUs, const std::string& args);
+
+	// current time in microseconds
+	static int64_t nowUs();
+
+private:
+	// recorded span
+	struct Event
+	{
+		std::string name;
+		const char* category;
+		int64_t beginUs;
+		int64_t endUs;
+		uint64_t thread;
+		std::string args;
+	};
+
+	std::atomic<bool> enabled;
+	std::vector<Event> events;
+	std::mutex mutex;
+
+	// libtorch operator callback (0 when not registered)
+	at::CallbackHandle torchHandle;
+
+	// tracer receiving the libtorch operators
+	static std::atomic<Tracer*> torchTracer;
+
+	// libtorch operator callbacks
+	static std::unique_ptr<at::ObserverContext> onOpStart(const at::RecordFunction& fn);
+	static void onOpEnd(const at::RecordFunction& fn, at::ObserverContext* context);
+
+	// stop collecting torch operators
+	void removeTorchCallback();
+};
+
+/**
+ * TraceSpan (records a span from its construction to its destruction)
+ */
+class TraceSpan
+{
+public:
+	/**
+	 * Constructor
+	 * @param tracer tracer to record to (may be null or stopped)
+	 * @param name span name
+	 */
+	TraceSpan(Tracer* tracer, const char* name)
+	{
+		this->tracer = tracer != nullptr && tracer->isEnabled() ? tracer : nullptr;
+		this->name = name;
+		this->beginUs = this->tracer != nullptr ? Tracer::nowUs() : 0;
+	}
+
+	~TraceSpan()
+	{
+		if (tracer != nullptr)
+		{
+			tracer->record(name, "yolov5", beginUs, Tracer::nowUs(), args);
+		}
+	}
+
+	/**
+	 * Add an argument to the span
+	 * @param key argument name
+	 * @param value argument value
+	 */
+	void arg(const char* key, int64_t value)
+	{
+		if (tracer != nullptr)
+		{
+			args += (args.empty() ? "\"" : ",\"") + std::string(key) + "\":" + std::to_string(value);
+		}
+	}
+
+private:
+	Tracer* tracer;
+	const char* name;
+	int64_t beginUs;
+	std::string args;
+};
+
+#endif // !TRACER_H
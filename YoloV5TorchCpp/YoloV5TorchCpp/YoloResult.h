@@ -0,0 +1,18 @@
+﻿#pragma once
+#ifndef YOLORESULT_H
+#define YOLORESULT_H
+
+/**
+ * Detection result of a item (shared by the C ABI and the inference server)
+ */
+struct YoloResult
+{
+	int ClassIndex;
+	float Confidence;
+	int X;
+	int Y;
+	int Width;
+	int Height;
+};
+
+#endif // !YOLORESULT_H
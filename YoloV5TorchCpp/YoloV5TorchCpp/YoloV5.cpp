@@ -3,79 +3,174 @@
 
 YoloV5::YoloV5(const std::string& torchScriptPath, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
 {
-	this->model = torch::jit::load(torchScriptPath);
-	this->initialize(isCuda, isHalf, height, width, confThres, iouThres);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	this->initialize(torch::jit::load(torchScriptPath), isCuda, isHalf, height, width, confThres, iouThres);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
 }
 
 YoloV5::YoloV5(const std::vector<char>& buffer, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
 {
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 	std::strstreambuf strStreamBuf(buffer.data(), buffer.size());
 	std::istream strIs(&strStreamBuf);
-	this->model = torch::jit::load(strIs);
-	this->initialize(isCuda, isHalf, height, width, confThres, iouThres);
+	this->initialize(torch::jit::load(strIs), isCuda, isHalf, height, width, confThres, iouThres);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
 }
 
 YoloV5::YoloV5(std::istream& stream, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
 {
-	this->model = torch::jit::load(stream);
-	this->initialize(isCuda, isHalf, height, width, confThres, iouThres);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	this->initialize(torch::jit::load(stream), isCuda, isHalf, height, width, confThres, iouThres);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
 }
 
-void YoloV5::initialize(bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
+YoloV5::YoloV5(const torch::jit::script::Module& model, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
 {
-	if (isCuda)
-	{
-		this->model.to(torch::kCUDA);
-	}
-	if (isHalf)
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	this->initialize(model, isCuda, isHalf, height, width, confThres, iouThres);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+YoloV5::YoloV5(const std::string& torchScriptPath, ModuleCache& cache, bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::vector<cv::Size> sizes;
+	this->initialize(cache.load(torchScriptPath, isCuda, isHalf, height, width, sizes), isCuda, isHalf, height, width, confThres, iouThres);
+	// the first frames do not pay the profiling and optimization of the executor
+	this->warmUp(sizes);
+	cache.saveResolutions(cache.getLastKey(), resolutions);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+YoloV5::YoloV5(const std::shared_ptr<InferenceBackend>& backend, int height, int width, float confThres, float iouThres)
+{
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	this->initialize(backend, height, width, confThres, iouThres);
+	this->coldStartMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void YoloV5::initialize(const torch::jit::script::Module& model, bool isCuda, bool isHalf,
+	int height, int width, float confThres, float iouThres)
+{
+	this->initialize(std::make_shared<TorchScriptBackend>(model, isCuda, isHalf), height, width, confThres, iouThres);
+}
+
+void YoloV5::initialize(const std::shared_ptr<InferenceBackend>& backend, int height, int width, float confThres, float iouThres)
+{
+	if (!backend)
 	{
-		this->model.to(torch::kHalf);
+		throw std::invalid_argument("no inference backend");
 	}
+	this->backend = backend;
 	this->height = height;
 	this->width = width;
-	this->isCuda = isCuda;
+	this->isCuda = backend->isCuda();
 	this->iouThres = iouThres;
 	this->confThres = confThres;
-	this->isHalf = isHalf;
-	this->model.eval();
+	this->isHalf = backend->isHalf();
+	this->channelsLast = false;
+	this->tracer.reset(new Tracer());
+	this->memory.reset(new MemoryAccount());
+	this->memory->setWeights(backend->getWeightBytes());
+	// 80 classes of coco until the output is seen
+	this->outputColumns = 85;
 	unsigned seed = time(0);
 	std::srand(seed);
 }
 
 std::vector<torch::Tensor> YoloV5::non_max_suppression(const torch::Tensor& prediction, float confThres, float iouThres)
 {
-	torch::Tensor xc = prediction.select(2, 4) > confThres;
+	int numClasses = prediction.size(2) - 5;
 	int maxWh = 4096;
-	int maxNms = 30000;
 	std::vector<torch::Tensor> output;
 	for (int i = 0; i < prediction.size(0); i++)
 	{
 		output.push_back(torch::zeros({ 0, 6 }));
 	}
+
+	// class columns kept by the filter and their confidence thresholds
+	std::vector<int64_t> classIndex;
+	std::vector<float> classThres;
+	float minThres = confThres;
+	int filterLength = filter.classes.empty() ? numClasses : (int)filter.classes.size();
+	for (int i = 0; i < filterLength; i++)
+	{
+		int clazz = filter.classes.empty() ? i : filter.classes[i];
+		if (clazz < 0 || clazz >= numClasses)
+		{
+			continue;
+		}
+		std::map<int, float>::const_iterator it = filter.classThres.find(clazz);
+		float thres = it == filter.classThres.end() ? confThres : it->second;
+		classIndex.push_back(clazz);
+		classThres.push_back(thres);
+		minThres = std::min(minThres, thres);
+	}
+	if (classIndex.empty())
+	{
+		return output;
+	}
+	bool allClasses = filter.classes.empty();
+	torch::Tensor classIndexT = torch::tensor(classIndex, torch::kLong).to(prediction.device());
+	torch::Tensor classThresT = torch::tensor(classThres, torch::kFloat).to(prediction.device());
+
+	torch::Tensor xc = prediction.select(2, 4) > minThres;
 	for (int i = 0; i < prediction.size(0); i++)
 	{
-		torch::Tensor x = prediction[i];
-		x = x.index_select(0, torch::nonzero(xc[i]).select(1, 0));
-		if (x.size(0) == 0) continue;
+		// objects above the threshold and their decoded boxes, released after each image
+		MemoryCharge candidates(memory.get(), MemoryAccount::CANDIDATES, 0);
+		torch::Tensor x;
+		{
+			TraceSpan span(tracer.get(), "decode");
+			span.arg("batch", i);
+			x = prediction[i];
+			x = x.index_select(0, torch::nonzero(xc[i]).select(1, 0));
+			span.arg("objects", x.size(0));
+			if (x.size(0) == 0) continue;
+			candidates.add(x.numel() * x.element_size());
 
-		x.slice(1, 5, x.size(1)).mul_(x.slice(1, 4, 5));
-		torch::Tensor box = xywh2xyxy(x.slice(1, 0, 4));
-		std::tuple<torch::Tensor, torch::Tensor> max_tuple = torch::max(x.slice(1, 5, x.size(1)), 1, true);
-		x = torch::cat({ box, std::get<0>(max_tuple), std::get<1>(max_tuple) }, 1);
-		x = x.index_select(0, torch::nonzero(std::get<0>(max_tuple) > confThres).select(1, 0));
+			// only the allowed classes are scored, the others never reach sorting or iou
+			torch::Tensor conf = x.slice(1, 5, x.size(1));
+			if (!allClasses)
+			{
+				conf = conf.index_select(1, classIndexT);
+			}
+			conf = conf * x.slice(1, 4, 5);
+			torch::Tensor box = xywh2xyxy(x.slice(1, 0, 4));
+			std::tuple<torch::Tensor, torch::Tensor> max_tuple = torch::max(conf, 1, true);
+			torch::Tensor score = std::get<0>(max_tuple);
+			torch::Tensor column = std::get<1>(max_tuple).select(1, 0);
+			torch::Tensor keep = score.select(1, 0).toType(torch::kFloat) > classThresT.index_select(0, column);
+			torch::Tensor clazz = classIndexT.index_select(0, column).unsqueeze(1).toType(x.scalar_type());
+			x = torch::cat({ box, score, clazz }, 1);
+			x = x.index_select(0, torch::nonzero(keep).select(1, 0));
+			candidates.add(x.numel() * x.element_size());
+			span.arg("candidates", x.size(0));
+		}
 		int n = x.size(0);
 		if (n == 0)
 		{
 			continue;
 		}
-		else if (n > maxNms)
+		TraceSpan span(tracer.get(), "nms");
+		span.arg("batch", i);
+		span.arg("candidates", n);
+		if (filter.maxCandidates > 0 && n > filter.maxCandidates)
 		{
-			x = x.index_select(0, x.select(1, 4).argsort(0, true).slice(0, 0, maxNms));
+			x = x.index_select(0, x.select(1, 4).argsort(0, true).slice(0, 0, filter.maxCandidates));
+		}
+		torch::Tensor boxes = x.slice(1, 0, 4);
+		if (!filter.agnostic)
+		{
+			boxes = boxes + x.slice(1, 5, 6) * maxWh;
 		}
-		torch::Tensor c = x.slice(1, 5, 6) * maxWh;
-		torch::Tensor boxes = x.slice(1, 0, 4) + c;
 		torch::Tensor scores = x.select(1, 4);
 		torch::Tensor ix = nms(boxes, scores, iouThres).to(x.device());
+		if (filter.maxDetections > 0 && ix.size(0) > filter.maxDetections)
+		{
+			ix = ix.slice(0, 0, filter.maxDetections);
+		}
+		span.arg("detections", ix.size(0));
 		output[i] = x.index_select(0, ix).cpu();
 	}
 	return output;
@@ -86,29 +181,107 @@ cv::Scalar YoloV5::getRandScalar()
 	return cv::Scalar(std::rand() % 256, std::rand() % 256, std::rand() % 256);
 }
 
-cv::Mat YoloV5::img2RGB(const cv::Mat& img)
+PixelFormat YoloV5::matFormat(const cv::Mat& img)
 {
-	int imgC = img.channels();
-	cv::Mat result;
-	if (imgC == 1)
+	switch (img.channels())
 	{
-		cv::cvtColor(img, result, cv::COLOR_GRAY2RGB);
+	case 1:
+		return PixelFormat::GRAY;
+	case 4:
+		return PixelFormat::BGRA;
+	default:
+		return PixelFormat::BGR;
 	}
-	else
+}
+
+cv::Mat YoloV5::descriptor2Mat(const ImageDescriptor& image)
+{
+	void* data = (void*)image.data;
+	switch (image.format)
 	{
-		cv::cvtColor(img, result, cv::COLOR_BGR2RGB);
+	case PixelFormat::GRAY:
+		return cv::Mat(image.height, image.width, CV_8UC1, data, image.stride);
+	case PixelFormat::BGRA:
+		return cv::Mat(image.height, image.width, CV_8UC4, data, image.stride);
+	case PixelFormat::NV12:
+	{
+		cv::Mat yuv(image.height * 3 / 2, image.width, CV_8UC1, data, image.stride);
+		cv::Mat bgr;
+		cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR_NV12);
+		return bgr;
 	}
-	return result;
+	default:
+		return cv::Mat(image.height, image.width, CV_8UC3, data, image.stride);
+	}
+}
+
+torch::Tensor YoloV5::img2Tensor(const cv::Mat& img, PixelFormat format)
+{
+	int channels = img.channels();
+	torch::Tensor data = torch::from_blob(img.data, { img.rows, img.cols, channels },
+		{ (int64_t)img.step[0], channels, 1 }, torch::kByte);
+
+	// source channel of red, green and blue
+	int order[3] = { 2, 1, 0 };
+	if (format == PixelFormat::RGB)
+	{
+		order[0] = 0;
+		order[2] = 2;
+	}
+	else if (format == PixelFormat::GRAY || channels == 1)
+	{
+		order[0] = order[1] = order[2] = 0;
+	}
+
+	torch::Tensor result = torch::empty({ 1, 3, img.rows, img.cols }, torch::kFloat);
+	for (int c = 0; c < 3; c++)
+	{
+		result[0][c].copy_(data.select(2, order[c]));
+	}
+	return result.div_(255);
+}
+
+ResizedMatData YoloV5::resize(const cv::Mat& img, int height, int width, int batch)
+{
+	TraceSpan span(tracer.get(), "resize");
+	span.arg("batch", batch);
+	return ResizedMatData::resize(img, height, width);
 }
 
-torch::Tensor YoloV5::img2Tensor(const cv::Mat& img)
+torch::Tensor YoloV5::tensorize(const cv::Mat& img, PixelFormat format, int batch)
 {
-	torch::Tensor data = torch::from_blob(img.data, { (int)height, (int)width, 3 }, torch::kByte);
-	data = data.permute({ 2, 0, 1 });
-	data = data.toType(torch::kFloat);
-	data = data.div(255);
-	data = data.unsqueeze(0);
-	return data;
+	TraceSpan span(tracer.get(), "tensorize");
+	span.arg("batch", batch);
+	return channelsLast ? img2TensorNHWC(img, format) : img2Tensor(img, format);
+}
+
+torch::Tensor YoloV5::img2TensorNHWC(const cv::Mat& img, PixelFormat format)
+{
+	torch::Tensor result = torch::empty({ 1, img.rows, img.cols, 3 }, torch::kFloat);
+	cv::Mat target(img.rows, img.cols, CV_32FC3, result.data_ptr<float>());
+
+	cv::Mat rgb;
+	if (format == PixelFormat::GRAY || img.channels() == 1)
+	{
+		cv::cvtColor(img, rgb, cv::COLOR_GRAY2RGB);
+	}
+	else if (img.channels() == 4)
+	{
+		cv::cvtColor(img, rgb, cv::COLOR_BGRA2RGB);
+	}
+	else if (format == PixelFormat::RGB)
+	{
+		rgb = img;
+	}
+	else
+	{
+		cv::cvtColor(img, rgb, cv::COLOR_BGR2RGB);
+	}
+	// written in place into the tensor memory
+	rgb.convertTo(target, CV_32F, 1.0 / 255);
+
+	// (1, height, width, rgb) viewed as (1, rgb, height, width) with channels_last strides
+	return result.permute({ 0, 3, 1, 2 });
 }
 
 torch::Tensor YoloV5::xywh2xyxy(const torch::Tensor& x)
@@ -123,89 +296,86 @@ torch::Tensor YoloV5::xywh2xyxy(const torch::Tensor& x)
 
 torch::Tensor YoloV5::nms(const torch::Tensor& bboxes, const torch::Tensor& scores, float thresh)
 {
-	auto x1 = bboxes.select(1, 0);
-	auto y1 = bboxes.select(1, 1);
-	auto x2 = bboxes.select(1, 2);
-	auto y2 = bboxes.select(1, 3);
-	auto areas = (x2 - x1) * (y2 - y1);
-	auto tuple_sorted = scores.sort(0, true);
-	auto order = std::get<1>(tuple_sorted);
+	// greedy suppression on host memory, the same arithmetic as the former tensor loop
+	// without one device round trip for every kept box
+	torch::Tensor boxes = bboxes.to(torch::kCPU, torch::kFloat).contiguous();
+	torch::Tensor order = std::get<1>(scores.sort(0, true)).to(torch::kCPU, torch::kLong).contiguous();
+	const float* b = boxes.data_ptr<float>();
+	const int64_t* o = order.data_ptr<int64_t>();
+	int64_t n = order.numel();
+
+	std::vector<float> areas(boxes.size(0));
+	for (int64_t i = 0; i < boxes.size(0); i++)
+	{
+		areas[i] = (b[i * 4 + 2] - b[i * 4]) * (b[i * 4 + 3] - b[i * 4 + 1]);
+	}
 
-	std::vector<int> keep;
-	while (order.numel() > 0)
+	std::vector<int64_t> keep;
+	std::vector<char> suppressed(n, 0);
+	for (int64_t i = 0; i < n; i++)
 	{
-		if (order.numel() == 1)
+		if (suppressed[i])
 		{
-			auto i = order.item();
-			keep.push_back(i.toInt());
-			break;
+			continue;
 		}
-		else
+		int64_t k = o[i];
+		keep.push_back(k);
+		const float* bk = b + k * 4;
+		for (int64_t j = i + 1; j < n; j++)
 		{
-			auto i = order[0].item();
-			keep.push_back(i.toInt());
-		}
-
-		auto order_mask = order.narrow(0, 1, order.size(-1) - 1);
-
-		auto xx1 = x1.index({ order_mask }).clamp(x1[keep.back()].item().toFloat(), 1e10);
-		auto yy1 = y1.index({ order_mask }).clamp(y1[keep.back()].item().toFloat(), 1e10);
-		auto xx2 = x2.index({ order_mask }).clamp(0, x2[keep.back()].item().toFloat());
-		auto yy2 = y2.index({ order_mask }).clamp(0, y2[keep.back()].item().toFloat());
-		auto inter = (xx2 - xx1).clamp(0, 1e10) * (yy2 - yy1).clamp(0, 1e10);
-
-		auto iou = inter / (areas[keep.back()] + areas.index({ order.narrow(0,1,order.size(-1) - 1) }) - inter);
-		auto idx = (iou <= thresh).nonzero().squeeze();
-		if (idx.numel() == 0)
-		{
-			break;
+			if (suppressed[j])
+			{
+				continue;
+			}
+			const float* bj = b + o[j] * 4;
+			float xx1 = std::min(std::max(bj[0], bk[0]), 1e10f);
+			float yy1 = std::min(std::max(bj[1], bk[1]), 1e10f);
+			float xx2 = std::min(std::max(bj[2], 0.0f), bk[2]);
+			float yy2 = std::min(std::max(bj[3], 0.0f), bk[3]);
+			float inter = std::min(std::max(xx2 - xx1, 0.0f), 1e10f) * std::min(std::max(yy2 - yy1, 0.0f), 1e10f);
+			float iou = inter / (areas[k] + areas[o[j]] - inter);
+			// NaN is suppressed as well
+			if (!(iou <= thresh))
+			{
+				suppressed[j] = 1;
+			}
 		}
-		order = order.index({ idx + 1 });
 	}
-	return torch::tensor(keep);
+	return torch::tensor(keep, torch::kLong);
 }
 
 std::vector<torch::Tensor> YoloV5::sizeOriginal(const std::vector<torch::Tensor>& result,
 	const std::vector<ResizedMatData>& imgRDs)
 {
+	TraceSpan span(tracer.get(), "rescale");
+	span.arg("batchSize", result.size());
 	std::vector<torch::Tensor> resultOrg;
 	for (int i = 0; i < result.size(); i++)
 	{
-
 		torch::Tensor data = result[i];
 		ResizedMatData imgRD = imgRDs[i];
-		for (int j = 0; j < data.size(0); j++)
+		if (data.size(0) > 0)
 		{
-			torch::Tensor tensor = data.select(0, j);
-			// (left, top, right, bottom)
+			// (left, top, right, bottom), the border is removed then the boxes are scaled
+			float offsetX = 0, offsetY = 0, scaleX, scaleY;
 			if (imgRD.isSmallerWidth())
 			{
-				tensor[1] -= imgRD.getBorder();
-				tensor[3] -= imgRD.getBorder();
-				tensor[0] *= (float)imgRD.getOriginalWidth() / (float)imgRD.getWidth();
-				tensor[2] *= (float)imgRD.getOriginalWidth() / (float)imgRD.getWidth();
-				tensor[1] *= (float)imgRD.getOriginalHeight() / (float)(imgRD.getHeight() - 2 * imgRD.getBorder());
-				tensor[3] *= (float)imgRD.getOriginalHeight() / (float)(imgRD.getHeight() - 2 * imgRD.getBorder());
+				offsetY = (float)imgRD.getBorder();
+				scaleX = (float)imgRD.getOriginalWidth() / (float)imgRD.getWidth();
+				scaleY = (float)imgRD.getOriginalHeight() / (float)(imgRD.getHeight() - 2 * imgRD.getBorder());
 			}
 			else
 			{
-				tensor[0] -= imgRD.getBorder();
-				tensor[2] -= imgRD.getBorder();
-				tensor[1] *= (float)imgRD.getOriginalHeight() / (float)imgRD.getHeight();
-				tensor[3] *= (float)imgRD.getOriginalHeight() / (float)imgRD.getHeight();
-				tensor[0] *= (float)imgRD.getOriginalWidth() / (float)(imgRD.getWidth() - 2 * imgRD.getBorder());
-				tensor[2] *= (float)imgRD.getOriginalWidth() / (float)(imgRD.getWidth() - 2 * imgRD.getBorder());
+				offsetX = (float)imgRD.getBorder();
+				scaleX = (float)imgRD.getOriginalWidth() / (float)(imgRD.getWidth() - 2 * imgRD.getBorder());
+				scaleY = (float)imgRD.getOriginalHeight() / (float)imgRD.getHeight();
 			}
+			torch::Tensor offset = torch::tensor({ offsetX, offsetY, offsetX, offsetY }).to(data.device(), data.scalar_type());
+			torch::Tensor scale = torch::tensor({ scaleX, scaleY, scaleX, scaleY }).to(data.device(), data.scalar_type());
+			torch::Tensor box = data.slice(1, 0, 4);
 			// eliminate the negative number causing by the prediction result on the black border
-			for (int k = 0; k < 4; k++)
-			{
-				if (tensor[k].item().toFloat() < 0)
-				{
-					tensor[k] = 0;
-				}
-			}
+			box.sub_(offset).mul_(scale).clamp_min_(0);
 		}
-
 		resultOrg.push_back(data);
 	}
 	return resultOrg;
@@ -213,20 +383,33 @@ std::vector<torch::Tensor> YoloV5::sizeOriginal(const std::vector<torch::Tensor>
 
 std::vector<torch::Tensor> YoloV5::prediction(const torch::Tensor& data)
 {
-	torch::Tensor result;
-	if (!data.is_cuda() && this->isCuda)
+	torch::Tensor result = data;
+	if (!result.is_cuda() && this->isCuda)
+	{
+		result = result.cuda();
+	}
+	if (result.is_cuda() && !this->isCuda)
 	{
-		result = data.cuda();
+		result = result.cpu();
 	}
-	if (data.is_cuda() && !this->isCuda)
+	if (this->channelsLast)
 	{
-		result = data.cpu();
+		result = result.contiguous(at::MemoryFormat::ChannelsLast);
 	}
 	if (this->isHalf)
 	{
-		result = data.to(torch::kHalf);
+		result = result.to(torch::kHalf);
+	}
+	// copies made for the device, memory format or precision
+	MemoryCharge input(memory.get(), MemoryAccount::INPUT, result.is_same(data) ? 0 : result.numel() * result.element_size());
+	torch::Tensor pred;
+	{
+		TraceSpan span(tracer.get(), "forward");
+		span.arg("batchSize", result.size(0));
+		pred = backend->forward(result);
 	}
-	torch::Tensor pred = model.forward({ result }).toTuple()->elements()[0].toTensor();
+	outputColumns = pred.size(2);
+	MemoryCharge scratch(memory.get(), MemoryAccount::SCRATCH, pred.numel() * pred.element_size());
 	return non_max_suppression(pred, confThres, iouThres);
 }
 
@@ -238,33 +421,457 @@ std::vector<torch::Tensor> YoloV5::prediction(const std::string& filePath)
 
 std::vector<torch::Tensor> YoloV5::prediction(const cv::Mat& img)
 {
-	ResizedMatData imgRD = resize(img);
+	return prediction(img, (int)height, (int)width);
+}
 
-	cv::Mat reImg = img2RGB(imgRD.getMat());
-	torch::Tensor data = img2Tensor(reImg);
+std::vector<torch::Tensor> YoloV5::prediction(const cv::Mat& img, int height, int width)
+{
+	return prediction(img, matFormat(img), height, width, (int64_t)img.total() * img.elemSize());
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const ImageDescriptor& image)
+{
+	int pixelBytes = image.format == PixelFormat::BGRA ? 4 :
+		(image.format == PixelFormat::GRAY || image.format == PixelFormat::NV12) ? 1 : 3;
+	if (image.stride < 0)
+	{
+		// bottom-up rows (such as a locked bottom-up bitmap) cannot be read in place by an opencv mat
+		throw std::invalid_argument("negative stride (bottom-up image) is not supported");
+	}
+	if (image.data == nullptr || image.width <= 0 || image.height <= 0 || image.stride < image.width * pixelBytes)
+	{
+		throw std::invalid_argument("invalid image descriptor");
+	}
+	// the frame and its color conversion are admitted before the conversion is made
+	bool nv12 = image.format == PixelFormat::NV12;
+	int rows = nv12 ? image.height * 3 / 2 : image.height;
+	int64_t converted = nv12 ? (int64_t)image.width * image.height * 3 : 0;
+	int64_t available = memory->getAvailable();
+	if (available >= 0 && estimateBytes((int)height, (int)width, nv12 ? 3 : pixelBytes, 1) + (int64_t)image.stride * rows + converted > available)
+	{
+		throw std::runtime_error("the image exceeds the memory budget");
+	}
+	cv::Mat img;
+	{
+		TraceSpan span(tracer.get(), "color");
+		img = descriptor2Mat(image);
+	}
+	MemoryCharge conversion(memory.get(), MemoryAccount::INPUT, converted);
+	PixelFormat format = nv12 ? PixelFormat::BGR : image.format;
+	return prediction(img, format, (int)height, (int)width, 0);
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const cv::Mat& img, PixelFormat format, int height, int width, int64_t sourceBytes)
+{
+	ResultCache::Key key;
+	if (cache)
+	{
+		std::vector<torch::Tensor> cached;
+		if (cache->find(settingsHash(format, height, width), img, cached, key))
+		{
+			return cached;
+		}
+	}
+
+	int64_t available = memory->getAvailable();
+	if (available >= 0 && estimateBytes(height, width, img.channels(), 1) + sourceBytes > available)
+	{
+		throw std::runtime_error("the image exceeds the memory budget");
+	}
+
+	ResizedMatData imgRD = resize(img, height, width, 0);
+	MemoryCharge input(memory.get(), MemoryAccount::INPUT, imgRD.getMat().total() * imgRD.getMat().elemSize());
+
+	torch::Tensor data = tensorize(imgRD.getMat(), format);
+	input.add(data.numel() * data.element_size());
 
 	std::vector<torch::Tensor> result = prediction(data);
 	std::vector<ResizedMatData> imgRDs;
 	imgRDs.push_back(imgRD);
+	result = sizeOriginal(result, imgRDs);
+
+	if (cache)
+	{
+		cache->insert(img, result, key);
+	}
+	return result;
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const torch::Tensor& data, const std::vector<ResizedMatData>& imgRDs)
+{
+	std::vector<torch::Tensor> result = prediction(data);
 	return sizeOriginal(result, imgRDs);
 }
 
+std::vector<torch::Tensor> YoloV5::prediction(const cv::Mat& img, const std::vector<cv::Rect>& rois)
+{
+	return prediction(std::vector<cv::Mat>{ img }, std::vector<std::vector<cv::Rect>>{ rois });
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const std::vector<cv::Mat>& imgs, const std::vector<std::vector<cv::Rect>>& rois)
+{
+	if (rois.size() != imgs.size())
+	{
+		throw std::invalid_argument("one list of regions is needed for each image");
+	}
+
+	// image and rectangle of each crop
+	std::vector<int> owners;
+	std::vector<cv::Rect> crops;
+	for (int i = 0; i < imgs.size(); i++)
+	{
+		cv::Rect frame(0, 0, imgs[i].cols, imgs[i].rows);
+		std::vector<cv::Rect> regions = rois[i];
+		if (regions.empty())
+		{
+			regions.push_back(frame);
+		}
+		for (int j = 0; j < regions.size(); j++)
+		{
+			cv::Rect region = regions[j] & frame;
+			if (region.area() == 0)
+			{
+				continue;
+			}
+			owners.push_back(i);
+			crops.push_back(region);
+		}
+	}
+
+	// the crops are predicted in one batch, admitted as a whole with the source images
+	int64_t available = memory->getAvailable();
+	if (available >= 0 && !crops.empty())
+	{
+		int64_t bytes = candidateBytes((int)height, (int)width);
+		for (int k = 0; k < crops.size(); k++)
+		{
+			bytes += imageBytes((int)height, (int)width, imgs[owners[k]].channels());
+		}
+		for (int i = 0; i < imgs.size(); i++)
+		{
+			bytes += (int64_t)imgs[i].total() * imgs[i].elemSize();
+		}
+		if (bytes > available)
+		{
+			throw std::runtime_error("the regions exceed the memory budget");
+		}
+	}
+
+	std::vector<ResizedMatData> imgRDs;
+	std::vector<torch::Tensor> datas;
+	MemoryCharge input(memory.get(), MemoryAccount::INPUT, 0);
+	for (int k = 0; k < crops.size(); k++)
+	{
+		// header over the region, the pixels are read by the letterbox only
+		cv::Mat crop = imgs[owners[k]](crops[k]);
+		ResizedMatData imgRD = resize(crop, (int)height, (int)width, k);
+		input.add(imgRD.getMat().total() * imgRD.getMat().elemSize());
+		datas.push_back(tensorize(imgRD.getMat(), matFormat(imgs[owners[k]]), k));
+		input.add(datas.back().numel() * datas.back().element_size());
+		imgRDs.push_back(imgRD);
+	}
+
+	std::vector<std::vector<torch::Tensor>> detections(imgs.size());
+	if (!datas.empty())
+	{
+		torch::Tensor data = torch::cat(datas, 0);
+		input.add(data.numel() * data.element_size());
+		std::vector<torch::Tensor> result = sizeOriginal(prediction(data), imgRDs);
+		for (int k = 0; k < result.size(); k++)
+		{
+			// clip to the crop so that no box reaches past the region, then to image coordinates
+			const cv::Rect& region = crops[k];
+			torch::Tensor boxes = result[k].slice(1, 0, 4);
+			boxes.select(1, 0).clamp_(0, region.width);
+			boxes.select(1, 1).clamp_(0, region.height);
+			boxes.select(1, 2).clamp_(0, region.width);
+			boxes.select(1, 3).clamp_(0, region.height);
+			float x = (float)region.x, y = (float)region.y;
+			boxes.add_(torch::tensor({ x, y, x, y }).to(result[k].scalar_type()));
+			detections[owners[k]].push_back(result[k]);
+		}
+	}
+
+	std::vector<torch::Tensor> output;
+	for (int i = 0; i < imgs.size(); i++)
+	{
+		output.push_back(detections[i].empty() ? torch::zeros({ 0, 6 }) : mergeRois(detections[i]));
+	}
+	return output;
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const std::vector<cv::Mat>& imgs, const MosaicPacker& packer)
+{
+	std::vector<cv::Size> sizes;
+	for (int i = 0; i < imgs.size(); i++)
+	{
+		if (imgs[i].type() != imgs[0].type())
+		{
+			throw std::invalid_argument("mosaic frames must share one pixel type");
+		}
+		sizes.push_back(imgs[i].size());
+	}
+	std::vector<MosaicPacker::Mosaic> mosaics = packer.pack(sizes);
+	cv::Size canvasSize = packer.getCanvasSize();
+
+	// the canvases are predicted in one batch, admitted as a whole with the source frames
+	int64_t available = memory->getAvailable();
+	if (available >= 0 && !mosaics.empty())
+	{
+		int64_t bytes = estimateBytes(canvasSize.height, canvasSize.width, imgs[0].channels(), (int)mosaics.size());
+		for (int i = 0; i < imgs.size(); i++)
+		{
+			bytes += (int64_t)imgs[i].total() * imgs[i].elemSize();
+		}
+		if (bytes > available)
+		{
+			throw std::runtime_error("the mosaic exceeds the memory budget");
+		}
+	}
+
+	std::vector<torch::Tensor> datas;
+	MemoryCharge input(memory.get(), MemoryAccount::INPUT, 0);
+	for (int m = 0; m < mosaics.size(); m++)
+	{
+		TraceSpan span(tracer.get(), "pack");
+		span.arg("batch", m);
+		span.arg("tiles", mosaics[m].tiles.size());
+		cv::Mat canvas(canvasSize, imgs[0].type(), cv::Scalar::all(0));
+		for (const MosaicPacker::Tile& tile : mosaics[m].tiles)
+		{
+			cv::Mat target = canvas(tile.region);
+			if (tile.region.size() == imgs[tile.frame].size())
+			{
+				imgs[tile.frame].copyTo(target);
+			}
+			else
+			{
+				cv::resize(imgs[tile.frame], target, target.size(), 0, 0, cv::INTER_AREA);
+			}
+		}
+		datas.push_back(tensorize(canvas, matFormat(imgs[0]), m));
+		input.add(datas.back().numel() * datas.back().element_size());
+	}
+
+	std::vector<std::vector<torch::Tensor>> detections(imgs.size());
+	if (!datas.empty())
+	{
+		// the canvases are already of the input size, detections are in canvas coordinates
+		torch::Tensor data = torch::cat(datas, 0);
+		input.add(data.numel() * data.element_size());
+		std::vector<torch::Tensor> result = prediction(data);
+		TraceSpan span(tracer.get(), "unpack");
+		for (int m = 0; m < result.size(); m++)
+		{
+			torch::Tensor dets = result[m].to(torch::kCPU, torch::kFloat).contiguous();
+			const float* d = dets.data_ptr<float>();
+			for (int k = 0; k < dets.size(0); k++, d += 6)
+			{
+				float cx = (d[0] + d[2]) / 2, cy = (d[1] + d[3]) / 2;
+				for (const MosaicPacker::Tile& tile : mosaics[m].tiles)
+				{
+					const cv::Rect& r = tile.region;
+					if (cx < r.x || cy < r.y || cx >= r.x + r.width || cy >= r.y + r.height)
+					{
+						continue;
+					}
+					// clip to the tile so that nothing of a neighbour leaks in, then back to frame pixels
+					const cv::Mat& img = imgs[tile.frame];
+					float sx = (float)img.cols / r.width, sy = (float)img.rows / r.height;
+					float left = (std::max(d[0], (float)r.x) - r.x) * sx;
+					float top = (std::max(d[1], (float)r.y) - r.y) * sy;
+					float right = (std::min(d[2], (float)(r.x + r.width)) - r.x) * sx;
+					float bottom = (std::min(d[3], (float)(r.y + r.height)) - r.y) * sy;
+					detections[tile.frame].push_back(torch::tensor({ left, top, right, bottom, d[4], d[5] }));
+					break;
+				}
+				// a center in a gutter belongs to no frame
+			}
+		}
+	}
+
+	// the detections were unpacked on cpu, they are returned there without a copy back to the device
+	std::vector<torch::Tensor> output;
+	for (int i = 0; i < imgs.size(); i++)
+	{
+		output.push_back(detections[i].empty() ? torch::zeros({ 0, 6 }, torch::kFloat) : torch::stack(detections[i]));
+	}
+	return output;
+}
+
+torch::Tensor YoloV5::mergeRois(const std::vector<torch::Tensor>& detections)
+{
+	torch::Tensor merged = torch::cat(detections, 0);
+	if (detections.size() < 2 || merged.size(0) == 0)
+	{
+		return merged;
+	}
+	// an object seen by overlapping regions is kept once
+	torch::Tensor boxes = merged.slice(1, 0, 4);
+	if (!filter.agnostic)
+	{
+		boxes = boxes + merged.slice(1, 5, 6) * 4096;
+	}
+	torch::Tensor ix = nms(boxes, merged.select(1, 4), iouThres);
+	if (filter.maxDetections > 0 && ix.size(0) > filter.maxDetections)
+	{
+		ix = ix.slice(0, 0, filter.maxDetections);
+	}
+	return merged.index_select(0, ix);
+}
+
+std::vector<cv::Rect> YoloV5::maskRois(const cv::Mat& mask, int minArea)
+{
+	cv::Mat gray = mask;
+	if (mask.channels() > 1)
+	{
+		cv::cvtColor(mask, gray, mask.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+	}
+	cv::Mat binary = gray != 0;
+	cv::Mat labels, stats, centroids;
+	int count = cv::connectedComponentsWithStats(binary, labels, stats, centroids, 8);
+
+	std::vector<cv::Rect> rois;
+	// label 0 is the background
+	for (int i = 1; i < count; i++)
+	{
+		if (stats.at<int>(i, cv::CC_STAT_AREA) < minArea)
+		{
+			continue;
+		}
+		rois.emplace_back(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+			stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+	}
+	return rois;
+}
+
+ResizedMatData YoloV5::preprocess(const cv::Mat& img, int height, int width, torch::Tensor& data)
+{
+	ResizedMatData imgRD = resize(img, height, width, 0);
+	data = tensorize(imgRD.getMat(), matFormat(img));
+	return imgRD;
+}
+
+uint64_t YoloV5::settingsHash(PixelFormat format, int height, int width)
+{
+	uint64_t hash = ResultCache::combine((uint64_t)height << 32 | (uint32_t)width, (uint64_t)format);
+	uint32_t bits;
+	std::memcpy(&bits, &confThres, sizeof(bits));
+	hash = ResultCache::combine(hash, bits);
+	std::memcpy(&bits, &iouThres, sizeof(bits));
+	hash = ResultCache::combine(hash, bits);
+	hash = ResultCache::combine(hash, isHalf);
+	hash = ResultCache::combine(hash, filter.agnostic);
+	hash = ResultCache::combine(hash, (uint32_t)filter.maxCandidates);
+	hash = ResultCache::combine(hash, (uint32_t)filter.maxDetections);
+	for (int i = 0; i < filter.classes.size(); i++)
+	{
+		hash = ResultCache::combine(hash, (uint32_t)filter.classes[i]);
+	}
+	for (std::map<int, float>::const_iterator it = filter.classThres.begin(); it != filter.classThres.end(); it++)
+	{
+		std::memcpy(&bits, &it->second, sizeof(bits));
+		hash = ResultCache::combine(hash, ((uint64_t)(uint32_t)it->first << 32) | bits);
+	}
+	return hash;
+}
+
 std::vector<torch::Tensor> YoloV5::prediction(const std::vector<cv::Mat>& imgs)
+{
+	int64_t available = memory->getAvailable();
+	if (available < 0)
+	{
+		return prediction(imgs, 0, imgs.size());
+	}
+
+	// greedy batches of the images that fit in the budget beside one image of candidates
+	int64_t room = available - candidateBytes((int)height, (int)width);
+	std::vector<torch::Tensor> result;
+	size_t begin = 0;
+	while (begin < imgs.size())
+	{
+		size_t end = begin;
+		int64_t bytes = 0;
+		while (end < imgs.size())
+		{
+			int64_t image = imageBytes((int)height, (int)width, imgs[end].channels()) + (int64_t)imgs[end].total() * imgs[end].elemSize();
+			if (bytes + image > room)
+			{
+				break;
+			}
+			bytes += image;
+			end++;
+		}
+		if (end == begin)
+		{
+			throw std::runtime_error("an image exceeds the memory budget");
+		}
+		std::vector<torch::Tensor> batch = prediction(imgs, begin, end);
+		result.insert(result.end(), batch.begin(), batch.end());
+		begin = end;
+	}
+	return result;
+}
+
+std::vector<torch::Tensor> YoloV5::prediction(const std::vector<cv::Mat>& imgs, size_t begin, size_t end)
 {
 	std::vector<ResizedMatData> imageRDs;
 	std::vector<torch::Tensor> datas;
-	for (int i = 0; i < imgs.size(); i++)
+	MemoryCharge input(memory.get(), MemoryAccount::INPUT, 0);
+	for (size_t i = begin; i < end; i++)
 	{
-		ResizedMatData imgRD = resize(imgs[i]);
+		ResizedMatData imgRD = resize(imgs[i], (int)height, (int)width, (int)(i - begin));
 		imageRDs.push_back(imgRD);
-		cv::Mat img = img2RGB(imgRD.getMat());
-		datas.push_back(img2Tensor(img));
+		input.add(imgRD.getMat().total() * imgRD.getMat().elemSize());
+		datas.push_back(tensorize(imgRD.getMat(), matFormat(imgs[i]), (int)(i - begin)));
+		input.add(datas.back().numel() * datas.back().element_size());
 	}
 	torch::Tensor data = torch::cat(datas, 0);
+	input.add(data.numel() * data.element_size());
 	std::vector<torch::Tensor> result = prediction(data);
 	return sizeOriginal(result, imageRDs);
 }
 
+int64_t YoloV5::imageBytes(int height, int width, int channels)
+{
+	int64_t pixels = (int64_t)height * width;
+	// letterbox, float tensor of the image and its copy in the batch
+	int64_t bytes = pixels * channels + 2 * pixels * 3 * 4;
+	if (isHalf)
+	{
+		bytes += pixels * 3 * 2;
+	}
+	// raw output
+	return bytes + outputRows(height, width) * outputColumns * (isHalf ? 2 : 4);
+}
+
+int64_t YoloV5::outputRows(int height, int width)
+{
+	// 3 anchors on the strides 8, 16 and 32
+	return 3 * ((int64_t)(height / 8) * (width / 8) + (int64_t)(height / 16) * (width / 16) + (int64_t)(height / 32) * (width / 32));
+}
+
+int64_t YoloV5::candidateBytes(int height, int width)
+{
+	// every row above the threshold, then its box, score and class
+	return outputRows(height, width) * (outputColumns + 6) * (isHalf ? 2 : 4);
+}
+
+int64_t YoloV5::estimateBytes(int height, int width, int channels, int batch)
+{
+	return batch * imageBytes(height, width, channels) + candidateBytes(height, width);
+}
+
+void YoloV5::setMemoryBudget(int64_t bytes)
+{
+	memory->setBudget(bytes);
+}
+
+MemoryAccount* YoloV5::getMemory()
+{
+	return memory.get();
+}
+
 ResizedMatData YoloV5::resize(const cv::Mat& img)
 {
 	return ResizedMatData::resize(img, height, width);
@@ -390,4 +997,135 @@ bool YoloV5::predictionExists(const std::vector<torch::Tensor>& classs)
 		}
 	}
 	return false;
+}
+
+void YoloV5::warmUp(const std::vector<cv::Size>& sizes, int iterations)
+{
+	for (int i = 0; i < sizes.size(); i++)
+	{
+		torch::Tensor data = torch::zeros({ 1, 3, sizes[i].height, sizes[i].width });
+		for (int j = 0; j < iterations; j++)
+		{
+			prediction(data);
+		}
+		if (std::find(resolutions.begin(), resolutions.end(), sizes[i]) == resolutions.end())
+		{
+			resolutions.push_back(sizes[i]);
+		}
+	}
+}
+
+std::vector<cv::Size> YoloV5::getResolutions()
+{
+	return resolutions;
+}
+
+cv::Size YoloV5::getInputSize()
+{
+	return cv::Size((int)width, (int)height);
+}
+
+void YoloV5::setFilter(const DetectionFilter& filter)
+{
+	this->filter = filter;
+}
+
+DetectionFilter YoloV5::getFilter()
+{
+	return filter;
+}
+
+void YoloV5::enableCache(size_t byteBudget)
+{
+	if (byteBudget == 0)
+	{
+		cache.reset();
+	}
+	else
+	{
+		cache.reset(new ResultCache(byteBudget));
+	}
+}
+
+ResultCache* YoloV5::getCache()
+{
+	return cache.get();
+}
+
+void YoloV5::startTrace(bool torchOps)
+{
+	tracer->start(torchOps);
+}
+
+bool YoloV5::stopTrace(const std::string& path)
+{
+	return tracer->stop(path);
+}
+
+Tracer* YoloV5::getTracer()
+{
+	return tracer.get();
+}
+
+double YoloV5::getColdStartMs()
+{
+	return coldStartMs;
+}
+
+bool YoloV5::enableChannelsLast()
+{
+	if (channelsLast)
+	{
+		return true;
+	}
+	std::shared_ptr<TorchScriptBackend> torchScript = std::dynamic_pointer_cast<TorchScriptBackend>(backend);
+	if (!torchScript)
+	{
+		// other engines choose their own memory format
+		return false;
+	}
+	// the module and its parameters may be shared with pool replicas or other instances of the same
+	// backend, the conversion works on a clone that only this instance runs
+	torch::jit::script::Module model = torchScript->getModule().clone();
+	torch::NoGradGuard noGrad;
+	// a module loaded from the ModuleCache is already frozen and has no parameters left
+	for (torch::Tensor parameter : model.parameters())
+	{
+		if (parameter.dim() == 4)
+		{
+			parameter.set_data(parameter.contiguous(at::MemoryFormat::ChannelsLast));
+		}
+	}
+	channelsLast = true;
+
+	model.eval();
+	bool optimized = true;
+	try
+	{
+		// freezes the module and folds conv + batchnorm, on cpu the convolutions also become
+		// prepacked oneDNN ops fused with their activations
+		model = isCuda ? torch::jit::freeze(model) : torch::jit::optimize_for_inference(model);
+	}
+	catch (std::exception&)
+	{
+		optimized = false;
+	}
+	backend = std::make_shared<TorchScriptBackend>(model, isCuda, isHalf);
+	memory->setWeights(backend->getWeightBytes());
+	if (!resolutions.empty())
+	{
+		std::vector<cv::Size> sizes = resolutions;
+		warmUp(sizes);
+	}
+	return optimized;
+}
+
+bool YoloV5::isChannelsLast()
+{
+	return channelsLast;
+}
+
+std::shared_ptr<InferenceBackend> YoloV5::getBackend()
+{
+	return backend;
 }
\ No newline at end of file
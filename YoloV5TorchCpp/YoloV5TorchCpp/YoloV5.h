@@ -6,8 +6,19 @@
 #include <torch/script.h>
 #include <iostream>
 #include <ctime>
+#include <chrono>
+#include <atomic>
+#include <cstring>
 #include <strstream>
 #include "ResizedMatData.h"
+#include "DetectionFilter.h"
+#include "ImageDescriptor.h"
+#include "ResultCache.h"
+#include "Tracer.h"
+#include "ModuleCache.h"
+#include "MosaicPacker.h"
+#include "TorchScriptBackend.h"
+#include "MemoryAccount.h"
 
 /**
  * YoloV5 Class
@@ -51,6 +62,42 @@ public:
 	YoloV5(std::istream& stream, bool isCuda = false, bool isHalf = false,
 		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
 
+	/**
+	 * Constructor (shares the weights of an already loaded model)
+	 * @param model loaded torchscript module
+	 * @param isCuda is using Cuda (default using)
+	 * @param height YoloV5 Training images' height
+	 * @param width YoloV5 Training images' width
+	 * @param confThres non maximum suppression's scoreThresh
+	 * @param iouThres non maximum suppression's iouThresh
+	 */
+	YoloV5(const torch::jit::script::Module& model, bool isCuda = false, bool isHalf = false,
+		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
+
+	/**
+	 * Constructor (loads the frozen module of the cache and warms it up on its recorded resolutions)
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param cache cache of frozen modules, the artifact is built on a miss
+	 * @param isCuda is using Cuda (default using)
+	 * @param height YoloV5 Training images' height
+	 * @param width YoloV5 Training images' width
+	 * @param confThres non maximum suppression's scoreThresh
+	 * @param iouThres non maximum suppression's iouThresh
+	 */
+	YoloV5(const std::string& torchScriptPath, ModuleCache& cache, bool isCuda = false, bool isHalf = false,
+		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
+
+	/**
+	 * Constructor (forward pass on another engine, the pre and postprocessing are the same)
+	 * @param backend inference backend, its device and precision are used
+	 * @param height YoloV5 Training images' height
+	 * @param width YoloV5 Training images' width
+	 * @param confThres non maximum suppression's scoreThresh
+	 * @param iouThres non maximum suppression's iouThresh
+	 */
+	YoloV5(const std::shared_ptr<InferenceBackend>& backend,
+		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
+
 	/**
 	 * prediction
 	 * @param data prediction data (batch, rgb, height, width)
@@ -71,10 +118,78 @@ public:
 
 	/**
 	 * prediction
+	 * @param img prediction image (opencv mat)
+	 * @param height input height of this prediction
+	 * @param width input width of this prediction
+	 */
+	std::vector<torch::Tensor> prediction(const cv::Mat& img, int height, int width);
+
+	/**
+	 * prediction (reads the caller memory in place, strided rows and sub-regions are supported,
+	 * bottom-up rows with a negative stride throw std::invalid_argument)
+	 * @param image prediction image descriptor
+	 */
+	std::vector<torch::Tensor> prediction(const ImageDescriptor& image);
+
+	/**
+	 * prediction, with a memory budget the images are predicted in the largest batches that fit
 	 * @param imgs prediction images (opencv mat)
 	 */
 	std::vector<torch::Tensor> prediction(const std::vector<cv::Mat>& imgs);
 
+	/**
+	 * prediction restricted to regions of interest, the regions of every image are cropped
+	 * without copy, letterboxed to the input size and predicted in a single batch
+	 * @param imgs prediction images (opencv mat)
+	 * @param rois regions of interest of each image (no region for the whole image)
+	 * @return prediction result of each image in image coordinates, merged across overlapping regions
+	 */
+	std::vector<torch::Tensor> prediction(const std::vector<cv::Mat>& imgs, const std::vector<std::vector<cv::Rect>>& rois);
+
+	/**
+	 * prediction restricted to regions of interest
+	 * @param img prediction image (opencv mat)
+	 * @param rois regions of interest (no region for the whole image)
+	 * @return prediction result in image coordinates
+	 */
+	std::vector<torch::Tensor> prediction(const cv::Mat& img, const std::vector<cv::Rect>& rois);
+
+	/**
+	 * prediction of small frames tiled into shared inputs, one canvas of the input size holds
+	 * several frames and the detections are assigned back to the frame under their center,
+	 * clipped to its tile
+	 * @param imgs prediction images of one pixel type (opencv mat)
+	 * @param packer tiling of the frames on the canvases (its canvas size is the input size)
+	 * @return prediction result of each image in image coordinates (float on cpu)
+	 */
+	std::vector<torch::Tensor> prediction(const std::vector<cv::Mat>& imgs, const MosaicPacker& packer);
+
+	/**
+	 * Regions of interest of a mask (bounding rectangles of its connected components)
+	 * @param mask mask of the image, non zero pixels are of interest
+	 * @param minArea smallest component kept in pixels
+	 * @return regions of interest
+	 */
+	static std::vector<cv::Rect> maskRois(const cv::Mat& mask, int minArea = 64);
+
+	/**
+	 * prediction of already tensorized images
+	 * @param data prediction data (batch, rgb, height, width)
+	 * @param imgRDs resized image data of each image in the batch
+	 * @return prediction result in the original image size
+	 */
+	std::vector<torch::Tensor> prediction(const torch::Tensor& data, const std::vector<ResizedMatData>& imgRDs);
+
+	/**
+	 * Letterbox and tensorize an image
+	 * @param img original image
+	 * @param height input height
+	 * @param width input width
+	 * @param data input tensor (1, rgb, height, width)
+	 * @return resized image data
+	 */
+	ResizedMatData preprocess(const cv::Mat& img, int height, int width, torch::Tensor& data);
+
 	/**
 	 * Resize mat image
 	 * @param img original image
@@ -181,7 +296,94 @@ public:
 	 */
 	bool predictionExists(const std::vector<torch::Tensor>& classs);
 
+	/**
+	 * Warm up the model for each input resolution
+	 * @param sizes input resolutions
+	 * @param iterations forward passes for each resolution
+	 */
+	void warmUp(const std::vector<cv::Size>& sizes, int iterations = 2);
+
+	// get the warmed up input resolutions
+	std::vector<cv::Size> getResolutions();
+
+	// get input resolution given to the constructor
+	cv::Size getInputSize();
+
+	/**
+	 * Set the filter applied before non maximum suppression
+	 * @param filter class allow-list, per class thresholds, agnostic switch and top-K caps
+	 */
+	void setFilter(const DetectionFilter& filter);
+
+	// get the filter applied before non maximum suppression
+	DetectionFilter getFilter();
+
+	/**
+	 * Cache the results of single image predictions by image content
+	 * @param byteBudget maximum bytes of the cached results (0 to disable the cache)
+	 */
+	void enableCache(size_t byteBudget);
+
+	// get the result cache (null when disabled)
+	ResultCache* getCache();
+
+	/**
+	 * Start recording the spans of the prediction stages
+	 * @param torchOps also record the libtorch operators
+	 */
+	void startTrace(bool torchOps = false);
+
+	/**
+	 * Stop recording and write the spans as a Chrome trace json file
+	 * @param path json path (open with chrome://tracing or ui.perfetto.dev)
+	 * @return false if the file cannot be written
+	 */
+	bool stopTrace(const std::string& path);
+
+	// get the tracer of the prediction stages
+	Tracer* getTracer();
+
+	// get milliseconds spent in the constructor (loading, conversion and warm up)
+	double getColdStartMs();
+
+	/**
+	 * Run the model in channels_last memory format, on cpu the weights are also
+	 * prepacked and fused for oneDNN (torch::jit::optimize_for_inference).
+	 * Preprocessing then writes NHWC directly. The conversion cannot be undone, it runs on a
+	 * clone of the module so that other instances sharing it are not affected.
+	 * @return false if the oneDNN optimization failed (the module is still channels_last)
+	 */
+	bool enableChannelsLast();
+
+	// is running in channels_last memory format
+	bool isChannelsLast();
+
+	// get the inference backend
+	std::shared_ptr<InferenceBackend> getBackend();
+
+	/**
+	 * Bound the memory of the instance, batches are split to fit and an image that cannot fit is rejected
+	 * @param bytes maximum bytes of the weights and the buffers of the running predictions (0 for no limit)
+	 */
+	void setMemoryBudget(int64_t bytes);
+
+	/**
+	 * Estimate the buffers of a prediction
+	 * @param height input height
+	 * @param width input width
+	 * @param channels channels of the images
+	 * @param batch images in the batch
+	 * @return bytes of the input, output and candidate buffers
+	 */
+	int64_t estimateBytes(int height, int width, int channels, int batch);
+
+	// get the memory account (weights, buffers, peak and budget)
+	MemoryAccount* getMemory();
+
 private:
+	// runs the private stages beside their reference implementations
+	friend class DifferentialHarness;
+
 	// is using cuda
 	bool isCuda;
 
@@ -200,20 +402,80 @@ private:
 	// training model width
 	float width;
 
+	// is running in channels_last memory format
+	bool channelsLast;
+
+	// filter applied before non maximum suppression
+	DetectionFilter filter;
+
+	// cache of prediction results (null when disabled)
+	std::shared_ptr<ResultCache> cache;
+
+	// spans of the prediction stages
+	std::shared_ptr<Tracer> tracer;
+
+	// bytes held by the instance
+	std::shared_ptr<MemoryAccount> memory;
+
+	// columns of the raw output (5 + classes), known after the first forward pass (written by concurrent predictions)
+	std::atomic<int64_t> outputColumns;
+
+	// milliseconds spent in the constructor
+	double coldStartMs;
+
+	// warmed up input resolutions
+	std::vector<cv::Size> resolutions;
+
 	// map of binginding box colour
 	std::map<int, cv::Scalar> mainColors;
 
-	// torchscript model
-	torch::jit::script::Module model;
+	// engine of the forward pass
+	std::shared_ptr<InferenceBackend> backend;
 
 	// random get a colour
 	cv::Scalar getRandScalar();
 
-	// cv mat to rgb format
-	cv::Mat img2RGB(const cv::Mat& img);
+	// pixel format of a cv mat (BGR, BGRA or GRAY by channels)
+	static PixelFormat matFormat(const cv::Mat& img);
 
-	// cv mat to Tensor format
-	torch::Tensor img2Tensor(const cv::Mat& img);
+	// cv mat header over the descriptor memory (NV12 is converted to BGR)
+	static cv::Mat descriptor2Mat(const ImageDescriptor& image);
+
+	// cv mat to rgb Tensor format, channel order and type are converted in a single pass
+	torch::Tensor img2Tensor(const cv::Mat& img, PixelFormat format);
+
+	// letterbox an image, traced as the resize stage
+	ResizedMatData resize(const cv::Mat& img, int height, int width, int batch);
+
+	// cv mat to rgb Tensor (1, rgb, height, width) stored as NHWC, without transpose
+	torch::Tensor img2TensorNHWC(const cv::Mat& img, PixelFormat format);
+
+	// img2Tensor or img2TensorNHWC traced as the tensorize stage (color conversion included)
+	torch::Tensor tensorize(const cv::Mat& img, PixelFormat format, int batch = 0);
+
+	// predict the images [begin, end) in one batch
+	std::vector<torch::Tensor> prediction(const std::vector<cv::Mat>& imgs, size_t begin, size_t end);
+
+	// buffers of one image of a batch, without the candidates
+	int64_t imageBytes(int height, int width, int channels);
+
+	// rows of the raw output of one image
+	static int64_t outputRows(int height, int width);
+
+	// candidate buffers of non maximum suppression (one image at a time)
+	int64_t candidateBytes(int height, int width);
+
+	/**
+	 * letterbox, tensorize and predict an image of the given pixel format
+	 * @param sourceBytes bytes of the source frames read by the prediction, added to its buffers for the budget
+	 */
+	std::vector<torch::Tensor> prediction(const cv::Mat& img, PixelFormat format, int height, int width, int64_t sourceBytes);
+
+	// hash of the settings a cached result depends on
+	uint64_t settingsHash(PixelFormat format, int height, int width);
+
+	// merge the detections of the regions of an image with non maximum suppression
+	torch::Tensor mergeRois(const std::vector<torch::Tensor>& detections);
 
 	// (center_x center_y w h) to (left, top, right, bottom)
 	torch::Tensor xywh2xyxy(const torch::Tensor& x);
@@ -229,8 +491,13 @@ private:
 	std::vector<torch::Tensor> non_max_suppression(const torch::Tensor& preds,
 		float confThres = 0.25, float iouThres = 0.45);
 
+	// Initialization function, the backend is created from the torchscript module
+	void initialize(const torch::jit::script::Module& model, bool isCuda, bool isHalf,
+		int height, int width, float confThres, float iouThres);
+
 	// Initialization function
-	void initialize(bool isCuda, bool isHalf, int height, int width, float confThres, float iouThres);
+	void initialize(const std::shared_ptr<InferenceBackend>& backend,
+		int height, int width, float confThres, float iouThres);
 };
 
 #endif // !YOLOV5_H
\ No newline at end of file
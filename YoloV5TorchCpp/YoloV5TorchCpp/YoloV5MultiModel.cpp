@@ -0,0 +1,78 @@
+﻿#include "YoloV5MultiModel.h"
+
+YoloV5MultiModel::YoloV5MultiModel(const std::vector<YoloV5*>& models, bool concurrent)
+{
+	this->models = models;
+	this->concurrent = concurrent;
+}
+
+int YoloV5MultiModel::getModelCount()
+{
+	return models.size();
+}
+
+std::vector<torch::Tensor> YoloV5MultiModel::prediction(const cv::Mat& img)
+{
+	std::vector<cv::Mat> imgs;
+	imgs.push_back(img);
+	std::vector<std::vector<torch::Tensor>> results = prediction(imgs);
+	std::vector<torch::Tensor> result;
+	for (int i = 0; i < results.size(); i++)
+	{
+		result.push_back(results[i][0]);
+	}
+	return result;
+}
+
+std::vector<std::vector<torch::Tensor>> YoloV5MultiModel::prediction(const std::vector<cv::Mat>& imgs)
+{
+	// one input batch per distinct (height, width)
+	std::map<std::pair<int, int>, std::pair<torch::Tensor, std::vector<ResizedMatData>>> inputs;
+	for (int i = 0; i < models.size(); i++)
+	{
+		cv::Size size = models[i]->getInputSize();
+		std::pair<int, int> key(size.height, size.width);
+		if (inputs.find(key) != inputs.end())
+		{
+			continue;
+		}
+		std::vector<torch::Tensor> datas;
+		std::vector<ResizedMatData> imgRDs;
+		for (int j = 0; j < imgs.size(); j++)
+		{
+			torch::Tensor data;
+			imgRDs.push_back(models[i]->preprocess(imgs[j], size.height, size.width, data));
+			datas.push_back(data);
+		}
+		inputs[key] = std::make_pair(torch::cat(datas, 0), imgRDs);
+	}
+
+	std::vector<std::vector<torch::Tensor>> results(models.size());
+	if (!concurrent || models.size() == 1)
+	{
+		for (int i = 0; i < models.size(); i++)
+		{
+			cv::Size size = models[i]->getInputSize();
+			const auto& input = inputs.at(std::make_pair(size.height, size.width));
+			results[i] = models[i]->prediction(input.first, input.second);
+		}
+		return results;
+	}
+
+	std::vector<std::future<std::vector<torch::Tensor>>> futures;
+	for (int i = 0; i < models.size(); i++)
+	{
+		cv::Size size = models[i]->getInputSize();
+		const auto& input = inputs.at(std::make_pair(size.height, size.width));
+		YoloV5* model = models[i];
+		futures.push_back(std::async(std::launch::async, [model, &input]()
+			{
+				return model->prediction(input.first, input.second);
+			}));
+	}
+	for (int i = 0; i < futures.size(); i++)
+	{
+		results[i] = futures[i].get();
+	}
+	return results;
+}
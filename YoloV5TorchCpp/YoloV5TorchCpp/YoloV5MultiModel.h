@@ -0,0 +1,48 @@
+﻿#pragma once
+#ifndef YOLOV5MULTIMODEL_H
+#define YOLOV5MULTIMODEL_H
+
+#include <future>
+#include "YoloV5.h"
+
+/**
+ * YoloV5MultiModel Class (several models predicting the same frames)
+ * Each frame is letterboxed and tensorized once per distinct input size and the shared
+ * tensor is fed to every model of that size. Every model keeps its own thresholds and filter.
+ */
+class YoloV5MultiModel
+{
+public:
+	/**
+	 * Constructor
+	 * @param models models to run (not owned)
+	 * @param concurrent run the models on separate threads
+	 */
+	YoloV5MultiModel(const std::vector<YoloV5*>& models, bool concurrent = true);
+
+	/**
+	 * prediction
+	 * @param img prediction image (opencv mat)
+	 * @return prediction result of each model
+	 */
+	std::vector<torch::Tensor> prediction(const cv::Mat& img);
+
+	/**
+	 * prediction
+	 * @param imgs prediction images (opencv mat)
+	 * @return prediction results of each model, one per image
+	 */
+	std::vector<std::vector<torch::Tensor>> prediction(const std::vector<cv::Mat>& imgs);
+
+	// get number of models
+	int getModelCount();
+
+private:
+	// models to run
+	std::vector<YoloV5*> models;
+
+	// run the models on separate threads
+	bool concurrent;
+};
+
+#endif // !YOLOV5MULTIMODEL_H
@@ -0,0 +1,374 @@
+﻿#include "YoloV5Pool.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+YoloV5Pool::YoloV5Pool(const std::string& torchScriptPath, int replicas, int threadsPerReplica, bool pinCores,
+	int height, int width, float confThres, float iouThres)
+	: YoloV5Pool(torch::jit::load(torchScriptPath), replicas, threadsPerReplica, pinCores, height, width, confThres, iouThres)
+{
+}
+
+YoloV5Pool::YoloV5Pool(const torch::jit::script::Module& model, int replicas, int threadsPerReplica, bool pinCores,
+	int height, int width, float confThres, float iouThres)
+{
+	this->model = model;
+	this->model.eval();
+	this->pinCores = pinCores;
+	this->height = height;
+	this->width = width;
+	this->confThres = confThres;
+	this->iouThres = iouThres;
+	this->next = 0;
+	this->pending = 0;
+	this->stopping = false;
+	this->retuning = false;
+	threadsPerReplica = std::max(1, threadsPerReplica);
+	if (replicas <= 0)
+	{
+		replicas = std::max(1, hardwareCores() / threadsPerReplica);
+	}
+	start(replicas, threadsPerReplica);
+}
+
+YoloV5Pool::~YoloV5Pool()
+{
+	stop();
+}
+
+int YoloV5Pool::hardwareCores()
+{
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+int YoloV5Pool::getReplicas()
+{
+	return replicas;
+}
+
+int YoloV5Pool::getThreadsPerReplica()
+{
+	return threadsPerReplica;
+}
+
+void YoloV5Pool::start(int replicas, int threadsPerReplica)
+{
+	int cores = hardwareCores();
+	this->replicas = replicas;
+	this->threadsPerReplica = threadsPerReplica;
+	this->stopping = false;
+	// one intra-op budget for the process, the native thread pool, MKL and the oneDNN cache are global
+	at::set_num_threads(threadsPerReplica);
+	for (int i = 0; i < replicas; i++)
+	{
+		std::unique_ptr<Worker> worker(new Worker());
+		worker->yolov5.reset(new YoloV5(model, false, false, height, width, confThres, iouThres));
+		for (int j = 0; j < threadsPerReplica; j++)
+		{
+			worker->cores.push_back((i * threadsPerReplica + j) % cores);
+		}
+		workers.push_back(std::move(worker));
+	}
+	for (int i = 0; i < replicas; i++)
+	{
+		workers[i]->thread = std::thread(&YoloV5Pool::run, this, i);
+	}
+}
+
+void YoloV5Pool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < workers.size(); i++)
+	{
+		if (workers[i]->thread.joinable())
+		{
+			workers[i]->thread.join();
+		}
+	}
+	workers.clear();
+}
+
+void YoloV5Pool::pinCurrentThread(const std::vector<int>& cores)
+{
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (int i = 0; i < cores.size(); i++)
+	{
+		if (cores[i] < (int)sizeof(DWORD_PTR) * 8)
+		{
+			mask |= (DWORD_PTR)1 << cores[i];
+		}
+	}
+	if (mask != 0)
+	{
+		SetThreadAffinityMask(GetCurrentThread(), mask);
+	}
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < cores.size(); i++)
+	{
+		CPU_SET(cores[i], &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+void YoloV5Pool::run(int index)
+{
+	Worker& worker = *workers[index];
+	if (pinCores)
+	{
+		pinCurrentThread(worker.cores);
+	}
+	// the OpenMP team size is the only part of the budget kept per thread, a new thread starts from the default
+	if (at::get_num_threads() != threadsPerReplica)
+	{
+		at::set_num_threads(threadsPerReplica);
+	}
+
+	std::function<void(YoloV5&)> task;
+	while (true)
+	{
+		if (take(index, task))
+		{
+			task(*worker.yolov5);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wake.wait(lock, [this] { return stopping || pending > 0; });
+		if (stopping && pending == 0)
+		{
+			break;
+		}
+	}
+}
+
+bool YoloV5Pool::take(int index, std::function<void(YoloV5&)>& task)
+{
+	{
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty())
+		{
+			task = std::move(own.tasks.front());
+			own.tasks.pop_front();
+			pending--;
+			return true;
+		}
+	}
+	for (int i = 1; i < workers.size(); i++)
+	{
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.back());
+			victim.tasks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::future<void> YoloV5Pool::submit(const std::function<void(YoloV5&)>& task)
+{
+	// the workers are not replaced while a task is queued
+	std::unique_lock<std::mutex> lock(tuneMutex);
+	tuned.wait(lock, [this] { return !retuning; });
+	return enqueue(task);
+}
+
+std::future<void> YoloV5Pool::enqueue(const std::function<void(YoloV5&)>& task)
+{
+	std::shared_ptr<std::packaged_task<void(YoloV5&)>> packaged(new std::packaged_task<void(YoloV5&)>(task));
+	std::future<void> future = packaged->get_future();
+	Worker& worker = *workers[next++ % workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back([packaged](YoloV5& yolov5) { (*packaged)(yolov5); });
+	}
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		pending++;
+	}
+	wake.notify_one();
+	return future;
+}
+
+std::future<std::vector<torch::Tensor>> YoloV5Pool::submit(const cv::Mat& img)
+{
+	std::shared_ptr<std::promise<std::vector<torch::Tensor>>> promise(new std::promise<std::vector<torch::Tensor>>());
+	std::future<std::vector<torch::Tensor>> future = promise->get_future();
+	submit([promise, img](YoloV5& yolov5)
+		{
+			try
+			{
+				promise->set_value(yolov5.prediction(img));
+			}
+			catch (...)
+			{
+				promise->set_exception(std::current_exception());
+			}
+		});
+	return future;
+}
+
+std::vector<torch::Tensor> YoloV5Pool::prediction(const cv::Mat& img)
+{
+	return submit(img).get();
+}
+
+std::vector<torch::Tensor> YoloV5Pool::prediction(const std::vector<cv::Mat>& imgs)
+{
+	std::vector<std::future<std::vector<torch::Tensor>>> futures;
+	for (int i = 0; i < imgs.size(); i++)
+	{
+		futures.push_back(submit(imgs[i]));
+	}
+	std::vector<torch::Tensor> results;
+	for (int i = 0; i < futures.size(); i++)
+	{
+		results.push_back(futures[i].get()[0]);
+	}
+	return results;
+}
+
+double YoloV5Pool::autoTune(const cv::Mat& sample, float latencySloMs, int requests)
+{
+	{
+		// one retune at a time, submit blocks from here on
+		std::unique_lock<std::mutex> lock(tuneMutex);
+		tuned.wait(lock, [this] { return !retuning; });
+		retuning = true;
+	}
+	double throughput = -1;
+	try
+	{
+		throughput = search(sample, latencySloMs, requests);
+	}
+	catch (...)
+	{
+		{
+			std::lock_guard<std::mutex> lock(tuneMutex);
+			retuning = false;
+		}
+		tuned.notify_all();
+		throw;
+	}
+	{
+		std::lock_guard<std::mutex> lock(tuneMutex);
+		retuning = false;
+	}
+	tuned.notify_all();
+	return throughput;
+}
+
+double YoloV5Pool::search(const cv::Mat& sample, float latencySloMs, int requests)
+{
+	int cores = hardwareCores();
+	double bestThroughput = -1;
+	double bestLatency = std::numeric_limits<double>::max();
+	int bestReplicas = replicas;
+	int bestThreads = threadsPerReplica;
+	bool bestMeetsSlo = false;
+
+	// threads of powers of two up to the cores, each with replicas of powers of two up to twice the cores
+	// (under and oversubscribed) and the replicas filling the cores
+	std::vector<int> threadCandidates;
+	for (int threads = 1; threads < cores; threads *= 2)
+	{
+		threadCandidates.push_back(threads);
+	}
+	threadCandidates.push_back(cores);
+	std::vector<std::pair<int, int>> candidates;
+	for (int t = 0; t < threadCandidates.size(); t++)
+	{
+		int threads = threadCandidates[t];
+		int fill = std::max(1, cores / threads);
+		for (int reps = 1; reps * threads <= 2 * cores; reps *= 2)
+		{
+			candidates.emplace_back(reps, threads);
+		}
+		if (std::find(candidates.begin(), candidates.end(), std::make_pair(fill, threads)) == candidates.end())
+		{
+			candidates.emplace_back(fill, threads);
+		}
+	}
+
+	for (int c = 0; c < candidates.size(); c++)
+	{
+		int reps = candidates[c].first;
+		int threads = candidates[c].second;
+		stop();
+		start(reps, threads);
+
+		// warm up every replica before measuring
+		std::vector<std::future<void>> warmUps;
+		for (int i = 0; i < reps * 2; i++)
+		{
+			warmUps.push_back(enqueue([&sample](YoloV5& yolov5) { yolov5.prediction(sample); }));
+		}
+		for (int i = 0; i < warmUps.size(); i++)
+		{
+			warmUps[i].get();
+		}
+
+		// keep one request in flight per replica
+		std::vector<double> latencies(requests);
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < requests; i += reps)
+		{
+			std::vector<std::future<void>> futures;
+			for (int j = i; j < std::min(requests, i + reps); j++)
+			{
+				auto queued = std::chrono::steady_clock::now();
+				futures.push_back(enqueue([&sample, &latencies, j, queued](YoloV5& yolov5)
+					{
+						yolov5.prediction(sample);
+						latencies[j] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queued).count();
+					}));
+			}
+			for (int j = 0; j < futures.size(); j++)
+			{
+				futures[j].get();
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		double throughput = requests / std::max(seconds, 1e-9);
+
+		std::sort(latencies.begin(), latencies.end());
+		double p99 = latencies.empty() ? 0 : latencies[(int)((latencies.size() - 1) * 0.99)];
+		bool meetsSlo = latencySloMs <= 0 || p99 <= latencySloMs;
+
+		if ((meetsSlo && (!bestMeetsSlo || throughput > bestThroughput)) ||
+			(!meetsSlo && !bestMeetsSlo && p99 < bestLatency))
+		{
+			bestThroughput = throughput;
+			bestLatency = p99;
+			bestReplicas = reps;
+			bestThreads = threads;
+			bestMeetsSlo = meetsSlo;
+		}
+	}
+
+	stop();
+	start(bestReplicas, bestThreads);
+	return bestThroughput;
+}
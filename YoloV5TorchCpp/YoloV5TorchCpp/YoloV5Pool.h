@@ -0,0 +1,169 @@
+﻿#pragma once
+#ifndef YOLOV5POOL_H
+#define YOLOV5POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include "YoloV5.h"
+
+/**
+ * YoloV5Pool Class (CPU replicas of one torchscript model)
+ * Every replica shares the weights of the loaded model, runs on its own worker thread
+ * and is optionally pinned to its own core set. The intra-op thread budget is one value for the
+ * whole process (at::set_num_threads), set when the workers start, so pools of one process must agree on it.
+ * Requests are queued round robin and idle workers steal from the busy ones.
+ */
+class YoloV5Pool
+{
+public:
+	/**
+	 * Constructor
+	 * @param torchScriptPath YoloV5 torchscipt path
+	 * @param replicas number of model replicas (<= 0 to use all cores with threadsPerReplica)
+	 * @param threadsPerReplica intra-op threads of each replica (process-wide at::set_num_threads)
+	 * @param pinCores pin each replica to its own core set
+	 * @param height YoloV5 Training images' height
+	 * @param width YoloV5 Training images' width
+	 * @param confThres non maximum suppression's scoreThresh
+	 * @param iouThres non maximum suppression's iouThresh
+	 */
+	YoloV5Pool(const std::string& torchScriptPath, int replicas = 0, int threadsPerReplica = 4, bool pinCores = true,
+		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
+
+	/**
+	 * Constructor
+	 * @param model loaded torchscript module
+	 * @param replicas number of model replicas (<= 0 to use all cores with threadsPerReplica)
+	 * @param threadsPerReplica intra-op threads of each replica (process-wide at::set_num_threads)
+	 * @param pinCores pin each replica to its own core set
+	 * @param height YoloV5 Training images' height
+	 * @param width YoloV5 Training images' width
+	 * @param confThres non maximum suppression's scoreThresh
+	 * @param iouThres non maximum suppression's iouThresh
+	 */
+	YoloV5Pool(const torch::jit::script::Module& model, int replicas = 0, int threadsPerReplica = 4, bool pinCores = true,
+		int height = 640, int width = 640, float confThres = 0.25, float iouThres = 0.45);
+
+	// Destructor, waits for the queued requests
+	~YoloV5Pool();
+
+	/**
+	 * Queue a prediction
+	 * @param img prediction image (opencv mat), must stay alive until the future is ready
+	 * @return future of the prediction result
+	 */
+	std::future<std::vector<torch::Tensor>> submit(const cv::Mat& img);
+
+	/**
+	 * Queue a task running on one of the replicas, blocks while autoTune restarts the replicas
+	 * @param task task receiving the replica (must not submit to the pool itself)
+	 * @return future of the task
+	 */
+	std::future<void> submit(const std::function<void(YoloV5&)>& task);
+
+	/**
+	 * prediction
+	 * @param img prediction image (opencv mat)
+	 */
+	std::vector<torch::Tensor> prediction(const cv::Mat& img);
+
+	/**
+	 * prediction (each image is dispatched to the replicas separately)
+	 * @param imgs prediction images (opencv mat)
+	 */
+	std::vector<torch::Tensor> prediction(const std::vector<cv::Mat>& imgs);
+
+	/**
+	 * Search (replicas x threads) for the maximum throughput meeting the latency SLO
+	 * and restart the pool with the best configuration, submit waits until the search ends.
+	 * Threads are powers of two up to the cores, replicas powers of two up to twice the cores
+	 * in total threads plus the replicas filling the cores.
+	 * @param sample sample image used for the measurement
+	 * @param latencySloMs p99 latency limit in milliseconds (<= 0 for no limit)
+	 * @param requests requests measured for each configuration
+	 * @return throughput (images per second) of the chosen configuration
+	 */
+	double autoTune(const cv::Mat& sample, float latencySloMs, int requests = 64);
+
+	// get number of replicas
+	int getReplicas();
+
+	// get intra-op threads of each replica (the process-wide budget)
+	int getThreadsPerReplica();
+
+	// get number of logical cores
+	static int hardwareCores();
+
+private:
+	// queue and thread of a replica
+	struct Worker
+	{
+		std::deque<std::function<void(YoloV5&)>> tasks;
+		std::mutex mutex;
+		std::thread thread;
+		std::unique_ptr<YoloV5> yolov5;
+		std::vector<int> cores;
+	};
+
+	// shared torchscript model
+	torch::jit::script::Module model;
+
+	// replicas settings
+	int replicas;
+	int threadsPerReplica;
+	bool pinCores;
+	int height;
+	int width;
+	float confThres;
+	float iouThres;
+
+	// replica workers
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// next worker to receive a request
+	std::atomic<unsigned int> next;
+
+	// number of queued requests
+	std::atomic<int> pending;
+
+	// stop the workers
+	bool stopping;
+
+	// wake up idle workers
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	// autoTune is replacing the workers, submitters wait for the end of the retune
+	bool retuning;
+	std::mutex tuneMutex;
+	std::condition_variable tuned;
+
+	// start the workers
+	void start(int replicas, int threadsPerReplica);
+
+	// finish queued requests and join the workers
+	void stop();
+
+	// queue a task on the current workers
+	std::future<void> enqueue(const std::function<void(YoloV5&)>& task);
+
+	// measure the configurations of autoTune and restart with the best one
+	double search(const cv::Mat& sample, float latencySloMs, int requests);
+
+	// worker loop
+	void run(int index);
+
+	// pop a task from the own queue or steal one from the others
+	bool take(int index, std::function<void(YoloV5&)>& task);
+
+	// pin current thread to cores
+	static void pinCurrentThread(const std::vector<int>& cores);
+};
+
+#endif // !YOLOV5POOL_H
@@ -0,0 +1,251 @@
+﻿#include "YoloV5Scheduler.h"
+
+YoloV5Scheduler::YoloV5Scheduler(YoloV5* yolov5, int downgradeHeight, int downgradeWidth, int maxQueue)
+{
+	this->yolov5 = yolov5;
+	this->downgradeHeight = downgradeHeight;
+	this->downgradeWidth = downgradeWidth;
+	this->maxQueue = maxQueue > 0 ? maxQueue : 1;
+	this->stopping = false;
+	this->completed = 0;
+	this->downgraded = 0;
+	this->expired = 0;
+	this->superseded = 0;
+	this->dropped = 0;
+	this->thread = std::thread(&YoloV5Scheduler::run, this);
+}
+
+YoloV5Scheduler::~YoloV5Scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+	for (int i = 0; i < queue.size(); i++)
+	{
+		shed(queue[i], YoloV5ScheduleStatus::Dropped);
+	}
+	queue.clear();
+}
+
+std::future<YoloV5ScheduledResult> YoloV5Scheduler::submit(int streamId, const cv::Mat& img, float deadlineMs)
+{
+	std::shared_ptr<Request> request(new Request());
+	request->streamId = streamId;
+	request->img = img;
+	request->arrival = Clock::now();
+	request->hasDeadline = deadlineMs > 0;
+	request->deadline = request->arrival + std::chrono::microseconds((long long)(deadlineMs * 1000));
+	std::future<YoloV5ScheduledResult> future = request->promise.get_future();
+
+	std::vector<std::shared_ptr<Request>> stale;
+	std::shared_ptr<Request> full;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping)
+		{
+			full = request;
+		}
+		else
+		{
+			// only the freshest frame of a stream is worth serving
+			for (auto it = queue.begin(); it != queue.end();)
+			{
+				if ((*it)->streamId == streamId)
+				{
+					stale.push_back(*it);
+					it = queue.erase(it);
+				}
+				else
+				{
+					it++;
+				}
+			}
+			if (queue.size() >= maxQueue)
+			{
+				auto oldest = queue.begin();
+				for (auto it = queue.begin(); it != queue.end(); it++)
+				{
+					if ((*it)->arrival < (*oldest)->arrival)
+					{
+						oldest = it;
+					}
+				}
+				full = *oldest;
+				queue.erase(oldest);
+			}
+			queue.push_back(request);
+		}
+	}
+	wake.notify_one();
+
+	for (int i = 0; i < stale.size(); i++)
+	{
+		shed(stale[i], YoloV5ScheduleStatus::Superseded);
+	}
+	if (full)
+	{
+		shed(full, YoloV5ScheduleStatus::Dropped);
+	}
+	return future;
+}
+
+YoloV5ScheduledResult YoloV5Scheduler::prediction(int streamId, const cv::Mat& img, float deadlineMs)
+{
+	return submit(streamId, img, deadlineMs).get();
+}
+
+void YoloV5Scheduler::shed(const std::shared_ptr<Request>& request, YoloV5ScheduleStatus status)
+{
+	switch (status)
+	{
+	case YoloV5ScheduleStatus::Expired:
+		expired++;
+		break;
+	case YoloV5ScheduleStatus::Superseded:
+		superseded++;
+		break;
+	default:
+		dropped++;
+		break;
+	}
+	YoloV5ScheduledResult result;
+	result.status = status;
+	request->promise.set_value(result);
+}
+
+void YoloV5Scheduler::enableAdaptiveResolution(const std::vector<cv::Size>& resolutions, float highLatencyMs, float lowLatencyMs)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	controller.reset(new ResolutionController(resolutions, highLatencyMs, lowLatencyMs));
+}
+
+cv::Size YoloV5Scheduler::getResolution()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return controller ? controller->getResolution() : yolov5->getInputSize();
+}
+
+double YoloV5Scheduler::getEstimate(const cv::Size& size)
+{
+	auto it = estimatesMs.find(size.area());
+	return it == estimatesMs.end() ? 0 : it->second;
+}
+
+void YoloV5Scheduler::updateEstimate(const cv::Size& size, double sampleMs)
+{
+	double estimate = getEstimate(size);
+	estimatesMs[size.area()] = estimate <= 0 ? sampleMs : estimate * 0.8 + sampleMs * 0.2;
+}
+
+void YoloV5Scheduler::run()
+{
+	while (true)
+	{
+		std::shared_ptr<Request> request;
+		cv::Size full = yolov5->getInputSize();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (stopping)
+			{
+				break;
+			}
+			// earliest deadline first, requests without deadline last
+			auto earliest = queue.begin();
+			for (auto it = queue.begin(); it != queue.end(); it++)
+			{
+				const Request& a = **it;
+				const Request& b = **earliest;
+				if (a.hasDeadline != b.hasDeadline ? a.hasDeadline :
+					(a.hasDeadline && a.deadline != b.deadline ? a.deadline < b.deadline : a.arrival < b.arrival))
+				{
+					earliest = it;
+				}
+			}
+			request = *earliest;
+			queue.erase(earliest);
+			// under the lock, enableAdaptiveResolution may replace the controller at any time
+			if (controller)
+			{
+				controller->observe(std::chrono::duration<double, std::milli>(Clock::now() - request->arrival).count());
+				full = controller->getResolution();
+			}
+		}
+
+		cv::Size downgrade(downgradeWidth, downgradeHeight);
+
+		YoloV5ScheduleStatus status = YoloV5ScheduleStatus::Done;
+		if (request->hasDeadline)
+		{
+			double remainingMs = std::chrono::duration<double, std::milli>(request->deadline - Clock::now()).count();
+			if (remainingMs > 0 && getEstimate(full) <= remainingMs)
+			{
+				status = YoloV5ScheduleStatus::Done;
+			}
+			else if (remainingMs > 0 && downgradeHeight > 0 && downgradeWidth > 0 && getEstimate(downgrade) <= remainingMs)
+			{
+				status = YoloV5ScheduleStatus::Downgraded;
+			}
+			else
+			{
+				shed(request, YoloV5ScheduleStatus::Expired);
+				continue;
+			}
+		}
+
+		try
+		{
+			YoloV5ScheduledResult result;
+			result.status = status;
+			Clock::time_point begin = Clock::now();
+			if (status == YoloV5ScheduleStatus::Downgraded)
+			{
+				result.result = yolov5->prediction(request->img, downgrade.height, downgrade.width);
+				updateEstimate(downgrade, std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+				downgraded++;
+			}
+			else
+			{
+				result.result = yolov5->prediction(request->img, full.height, full.width);
+				updateEstimate(full, std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+				completed++;
+			}
+			request->promise.set_value(result);
+		}
+		catch (...)
+		{
+			request->promise.set_exception(std::current_exception());
+		}
+	}
+}
+
+long long YoloV5Scheduler::getCompleted()
+{
+	return completed;
+}
+
+long long YoloV5Scheduler::getDowngraded()
+{
+	return downgraded;
+}
+
+long long YoloV5Scheduler::getExpired()
+{
+	return expired;
+}
+
+long long YoloV5Scheduler::getSuperseded()
+{
+	return superseded;
+}
+
+long long YoloV5Scheduler::getDropped()
+{
+	return dropped;
+}
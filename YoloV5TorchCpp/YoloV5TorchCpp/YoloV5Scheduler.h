@@ -0,0 +1,167 @@
+﻿#pragma once
+#ifndef YOLOV5SCHEDULER_H
+#define YOLOV5SCHEDULER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <map>
+#include "YoloV5.h"
+#include "ResolutionController.h"
+
+/**
+ * Status of a scheduled prediction
+ */
+enum class YoloV5ScheduleStatus
+{
+	// predicted at full resolution
+	Done = 0,
+	// predicted at the downgraded resolution to meet the deadline
+	Downgraded = 1,
+	// shed, the deadline could not be met
+	Expired = 2,
+	// shed, a newer frame of the same stream arrived
+	Superseded = 3,
+	// shed, the queue was full
+	Dropped = 4
+};
+
+/**
+ * Result of a scheduled prediction
+ */
+struct YoloV5ScheduledResult
+{
+	YoloV5ScheduleStatus status;
+	// prediction result (empty when shed)
+	std::vector<torch::Tensor> result;
+};
+
+/**
+ * YoloV5Scheduler Class (deadline aware queue in front of YoloV5)
+ * Requests are served earliest deadline first. A request whose deadline cannot be met
+ * at full resolution is run at the downgraded resolution or shed, and a queued frame
+ * is superseded as soon as a newer frame of the same stream arrives.
+ */
+class YoloV5Scheduler
+{
+public:
+	/**
+	 * Constructor
+	 * @param yolov5 model serving the queue (not owned)
+	 * @param downgradeHeight input height used when full resolution misses the deadline (<= 0 to disable)
+	 * @param downgradeWidth input width used when full resolution misses the deadline (<= 0 to disable)
+	 * @param maxQueue queued requests before the most stale one is dropped
+	 */
+	YoloV5Scheduler(YoloV5* yolov5, int downgradeHeight = 320, int downgradeWidth = 320, int maxQueue = 64);
+
+	// Destructor, sheds the queued requests
+	~YoloV5Scheduler();
+
+	/**
+	 * Queue a prediction
+	 * @param streamId id of the source stream
+	 * @param img prediction image (opencv mat), must stay alive until the future is ready
+	 * @param deadlineMs milliseconds from now the result is useful for (<= 0 for no deadline)
+	 * @return future of the scheduled result
+	 */
+	std::future<YoloV5ScheduledResult> submit(int streamId, const cv::Mat& img, float deadlineMs);
+
+	/**
+	 * prediction (blocks until the request is served or shed)
+	 * @param streamId id of the source stream
+	 * @param img prediction image (opencv mat)
+	 * @param deadlineMs milliseconds from now the result is useful for (<= 0 for no deadline)
+	 */
+	YoloV5ScheduledResult prediction(int streamId, const cv::Mat& img, float deadlineMs);
+
+	/**
+	 * Choose the full input resolution from the queue latency
+	 * (the resolutions should be warmed up with YoloV5::warmUp)
+	 * @param resolutions available input resolutions
+	 * @param highLatencyMs queue latency to lower the resolution at
+	 * @param lowLatencyMs queue latency to raise the resolution at
+	 */
+	void enableAdaptiveResolution(const std::vector<cv::Size>& resolutions, float highLatencyMs, float lowLatencyMs);
+
+	// get current full input resolution
+	cv::Size getResolution();
+
+	// get number of requests served at full resolution
+	long long getCompleted();
+
+	// get number of requests served at the downgraded resolution
+	long long getDowngraded();
+
+	// get number of requests shed for missing the deadline
+	long long getExpired();
+
+	// get number of requests shed for a newer frame of the same stream
+	long long getSuperseded();
+
+	// get number of requests shed for a full queue
+	long long getDropped();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// queued request
+	struct Request
+	{
+		int streamId;
+		cv::Mat img;
+		Clock::time_point arrival;
+		Clock::time_point deadline;
+		bool hasDeadline;
+		std::promise<YoloV5ScheduledResult> promise;
+	};
+
+	// served model
+	YoloV5* yolov5;
+
+	// downgraded resolution
+	int downgradeHeight;
+	int downgradeWidth;
+
+	// maximum queue length
+	int maxQueue;
+
+	// estimated service time in milliseconds of each input area (0 until measured)
+	std::map<int, double> estimatesMs;
+
+	// chooses the full input resolution (null for the model resolution)
+	std::unique_ptr<ResolutionController> controller;
+
+	// queued requests
+	std::vector<std::shared_ptr<Request>> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	// worker thread
+	std::thread thread;
+
+	// counters
+	std::atomic<long long> completed;
+	std::atomic<long long> downgraded;
+	std::atomic<long long> expired;
+	std::atomic<long long> superseded;
+	std::atomic<long long> dropped;
+
+	// worker loop
+	void run();
+
+	// resolve a request without a prediction
+	void shed(const std::shared_ptr<Request>& request, YoloV5ScheduleStatus status);
+
+	// get the service time estimate of an input resolution
+	double getEstimate(const cv::Size& size);
+
+	// update the service time estimate of an input resolution
+	void updateEstimate(const cv::Size& size, double sampleMs);
+};
+
+#endif // !YOLOV5SCHEDULER_H
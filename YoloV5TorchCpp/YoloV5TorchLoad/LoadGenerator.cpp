@@ -0,0 +1,155 @@
+﻿#include "LoadGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+LoadGenerator::LoadGenerator(YoloV5Pool& pool, const std::vector<cv::Mat>& frames, const LoadSettings& settings)
+	: pool(pool)
+{
+	if (frames.empty())
+	{
+		throw std::invalid_argument("at least one frame is needed");
+	}
+	this->frames = frames;
+	this->settings = settings;
+}
+
+std::vector<LoadGenerator::Request> LoadGenerator::schedule()
+{
+	std::mt19937 random(settings.seed);
+	std::vector<Request> requests;
+	double endMs = settings.duration * 1000;
+	for (int s = 0; s < settings.streams; s++)
+	{
+		// streams start at different phases of their period
+		std::uniform_real_distribution<double> phase(0, 1000 / settings.fps);
+		double t = phase(random);
+		int burst = settings.arrival == "bursty" ? std::max(1, settings.burst) : 1;
+		// bursts keep the mean rate of the stream
+		std::exponential_distribution<double> gap(settings.fps / burst / 1000);
+		int frame = s % frames.size();
+		while (t < endMs)
+		{
+			for (int b = 0; b < burst; b++)
+			{
+				Request request;
+				request.stream = s;
+				request.frame = frame;
+				request.intendedMs = t;
+				request.sentMs = request.startMs = request.endMs = 0;
+				request.failed = false;
+				requests.push_back(request);
+				frame = (frame + 1) % frames.size();
+			}
+			t += settings.arrival == "constant" ? 1000 / settings.fps : gap(random);
+		}
+	}
+	std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b)
+		{
+			return a.intendedMs < b.intendedMs;
+		});
+	return requests;
+}
+
+std::string LoadGenerator::distribution(std::vector<double> values)
+{
+	std::ostringstream oss;
+	if (values.empty())
+	{
+		oss << "{\"p50\":0,\"p99\":0,\"p999\":0,\"max\":0,\"mean\":0}";
+		return oss.str();
+	}
+	std::sort(values.begin(), values.end());
+	// nearest rank
+	auto at = [&](double p)
+	{
+		size_t rank = (size_t)std::ceil(p * values.size());
+		return values[std::min(values.size() - 1, rank == 0 ? 0 : rank - 1)];
+	};
+	double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+	oss << "{\"p50\":" << at(0.5) << ",\"p99\":" << at(0.99) << ",\"p999\":" << at(0.999)
+		<< ",\"max\":" << values.back() << ",\"mean\":" << mean << "}";
+	return oss.str();
+}
+
+std::string LoadGenerator::run()
+{
+	std::vector<Request> requests = schedule();
+	std::vector<std::future<void>> futures;
+	futures.reserve(requests.size());
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	auto nowMs = [begin]()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	};
+
+	for (int i = 0; i < requests.size(); i++)
+	{
+		Request* request = &requests[i];
+		std::this_thread::sleep_until(begin + std::chrono::microseconds((int64_t)(request->intendedMs * 1000)));
+		request->sentMs = nowMs();
+		const cv::Mat& frame = frames[request->frame];
+		futures.push_back(pool.submit([request, &frame, nowMs](YoloV5& yolov5)
+			{
+				request->startMs = nowMs();
+				try
+				{
+					yolov5.prediction(frame);
+				}
+				catch (std::exception&)
+				{
+					request->failed = true;
+				}
+				request->endMs = nowMs();
+			}));
+	}
+	for (int i = 0; i < futures.size(); i++)
+	{
+		futures[i].wait();
+	}
+
+	double warmupMs = settings.warmup * 1000;
+	std::vector<double> latency, queue, service;
+	double firstMs = -1, lastMs = 0, maxLagMs = 0;
+	int failed = 0;
+	for (int i = 0; i < requests.size(); i++)
+	{
+		const Request& request = requests[i];
+		maxLagMs = std::max(maxLagMs, request.sentMs - request.intendedMs);
+		if (request.intendedMs < warmupMs)
+		{
+			continue;
+		}
+		if (request.failed)
+		{
+			failed++;
+			continue;
+		}
+		firstMs = firstMs < 0 ? request.intendedMs : firstMs;
+		lastMs = std::max(lastMs, request.endMs);
+		latency.push_back(request.endMs - request.intendedMs);
+		queue.push_back(request.startMs - request.intendedMs);
+		service.push_back(request.endMs - request.startMs);
+	}
+	double achieved = latency.empty() || lastMs <= firstMs ? 0 : latency.size() * 1000 / (lastMs - firstMs);
+
+	std::ostringstream oss;
+	oss << "{\"settings\":{\"streams\":" << settings.streams << ",\"fps\":" << settings.fps
+		<< ",\"arrival\":\"" << settings.arrival << "\",\"burst\":" << settings.burst
+		<< ",\"duration\":" << settings.duration << ",\"warmup\":" << settings.warmup << ",\"seed\":" << settings.seed
+		<< ",\"replicas\":" << pool.getReplicas() << ",\"threadsPerReplica\":" << pool.getThreadsPerReplica()
+		<< ",\"torch\":\"" << TORCH_VERSION_MAJOR << "." << TORCH_VERSION_MINOR << "." << TORCH_VERSION_PATCH << "\"}"
+		<< ",\"offeredFps\":" << settings.streams * settings.fps
+		<< ",\"achievedFps\":" << achieved
+		<< ",\"completed\":" << latency.size()
+		<< ",\"failed\":" << failed
+		<< ",\"maxDispatchLagMs\":" << maxLagMs
+		<< ",\"latencyMs\":" << distribution(latency)
+		<< ",\"queueMs\":" << distribution(queue)
+		<< ",\"serviceMs\":" << distribution(service) << "}";
+	return oss.str();
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <string>
+#include <vector>
+#include "YoloV5Pool.h"
+
+/**
+ * LoadSettings (offered load of the LoadGenerator)
+ */
+struct LoadSettings
+{
+	// number of camera streams
+	int streams = 4;
+	// frames per second of each stream
+	double fps = 15;
+	// arrivals: "constant", "poisson" or "bursty"
+	std::string arrival = "poisson";
+	// frames of a burst (bursty arrivals)
+	int burst = 5;
+	// seconds of load
+	double duration = 30;
+	// first seconds excluded from the statistics
+	double warmup = 2;
+	// seed of the arrivals
+	unsigned seed = 0;
+};
+
+/**
+ * LoadGenerator (open-loop load of camera streams on a YoloV5Pool)
+ * Frames are sent at their scheduled time whether or not the previous ones are finished,
+ * and latencies are measured from the scheduled time, so a stalled pool is not hidden
+ * by a generator waiting for it (coordinated omission).
+ */
+class LoadGenerator
+{
+public:
+	/**
+	 * Constructor
+	 * @param pool pool predicting the frames
+	 * @param frames frames looped by every stream
+	 * @param settings offered load
+	 */
+	LoadGenerator(YoloV5Pool& pool, const std::vector<cv::Mat>& frames, const LoadSettings& settings);
+
+	/**
+	 * Run the load
+	 * @return json report (settings, throughput, latency, queueing and service percentiles)
+	 */
+	std::string run();
+
+private:
+	// a scheduled frame, times in milliseconds from the start of the load
+	struct Request
+	{
+		int stream;
+		int frame;
+		double intendedMs;
+		double sentMs;
+		double startMs;
+		double endMs;
+		bool failed;
+	};
+
+	YoloV5Pool& pool;
+	std::vector<cv::Mat> frames;
+	LoadSettings settings;
+
+	// scheduled frames of every stream sorted by intended time
+	std::vector<Request> schedule();
+
+	// json object of the percentiles of a sample
+	static std::string distribution(std::vector<double> values);
+};
+
+#endif // !LOADGENERATOR_H
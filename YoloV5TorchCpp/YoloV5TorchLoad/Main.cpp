@@ -0,0 +1,123 @@
+﻿#include "LoadGenerator.h"
+#include "SyntheticModel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+/**
+ * YoloV5TorchLoad (open-loop multi-stream load generator)
+ * usage: YoloV5TorchLoad [--streams 4] [--fps 15] [--arrival poisson|bursty|constant] [--burst 5]
+ *                        [--duration 30] [--warmup 2] [--seed 0] [--model torchScriptPath]
+ *                        [--images a.jpg,b.jpg] [--replicas 0] [--threads 4] [--height 640] [--width 640]
+ *                        [--output report.json]
+ * Without --model a synthetic model is generated, without --images synthetic 1280x720 frames are looped.
+ * The json report is written to --output or to the standard output.
+ */
+
+// value of an option or its default
+static std::string option(int argc, char** argv, const char* name, const std::string& value)
+{
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (std::strcmp(argv[i], name) == 0)
+		{
+			return argv[i + 1];
+		}
+	}
+	return value;
+}
+
+// noise with a few filled rectangles
+static std::vector<cv::Mat> syntheticFrames(int count, unsigned seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> x(0, 1279), y(0, 719), size(20, 300), color(0, 255);
+	std::vector<cv::Mat> frames;
+	for (int i = 0; i < count; i++)
+	{
+		cv::Mat frame(720, 1280, CV_8UC3);
+		cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+		for (int j = 0; j < 10; j++)
+		{
+			cv::rectangle(frame, cv::Rect(x(random), y(random), size(random), size(random)),
+				cv::Scalar(color(random), color(random), color(random)), cv::FILLED);
+		}
+		frames.push_back(frame);
+	}
+	return frames;
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		LoadSettings settings;
+		settings.streams = std::atoi(option(argc, argv, "--streams", "4").c_str());
+		settings.fps = std::atof(option(argc, argv, "--fps", "15").c_str());
+		settings.arrival = option(argc, argv, "--arrival", "poisson");
+		settings.burst = std::atoi(option(argc, argv, "--burst", "5").c_str());
+		settings.duration = std::atof(option(argc, argv, "--duration", "30").c_str());
+		settings.warmup = std::atof(option(argc, argv, "--warmup", "2").c_str());
+		settings.seed = (unsigned)std::strtoul(option(argc, argv, "--seed", "0").c_str(), nullptr, 10);
+		if (settings.streams <= 0 || settings.fps <= 0 || settings.duration <= 0 ||
+			(settings.arrival != "poisson" && settings.arrival != "bursty" && settings.arrival != "constant"))
+		{
+			std::fprintf(stderr, "invalid load settings\n");
+			return 2;
+		}
+
+		int replicas = std::atoi(option(argc, argv, "--replicas", "0").c_str());
+		int threads = std::atoi(option(argc, argv, "--threads", "4").c_str());
+		int height = std::atoi(option(argc, argv, "--height", "640").c_str());
+		int width = std::atoi(option(argc, argv, "--width", "640").c_str());
+		std::string modelPath = option(argc, argv, "--model", "");
+		torch::jit::script::Module model = modelPath.empty() ?
+			SyntheticModel::create(80, settings.seed) : torch::jit::load(modelPath);
+		YoloV5Pool pool(model, replicas, threads, true, height, width);
+
+		std::vector<cv::Mat> frames;
+		std::string images = option(argc, argv, "--images", "");
+		std::stringstream paths(images);
+		std::string path;
+		while (std::getline(paths, path, ','))
+		{
+			cv::Mat frame = cv::imread(path);
+			if (frame.empty())
+			{
+				std::fprintf(stderr, "cannot read %s\n", path.c_str());
+				return 2;
+			}
+			frames.push_back(frame);
+		}
+		if (frames.empty())
+		{
+			frames = syntheticFrames(8, settings.seed);
+		}
+
+		LoadGenerator generator(pool, frames, settings);
+		std::fprintf(stderr, "%d stream(s) at %.1f fps (%s) for %.0f s on %d replica(s) x %d thread(s)\n",
+			settings.streams, settings.fps, settings.arrival.c_str(), settings.duration,
+			pool.getReplicas(), pool.getThreadsPerReplica());
+		std::string report = generator.run();
+
+		std::string output = option(argc, argv, "--output", "");
+		if (output.empty())
+		{
+			std::printf("%s\n", report.c_str());
+		}
+		else
+		{
+			std::ofstream file(output, std::ios::trunc);
+			file << report << "\n";
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::fprintf(stderr, "YoloV5TorchLoad Exception: %s\n", ex.what());
+		return 1;
+	}
+	return 0;
+}
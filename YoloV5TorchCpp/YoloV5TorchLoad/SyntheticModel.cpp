@@ -0,0 +1,21 @@
+﻿#include "SyntheticModel.h"
+
+torch::jit::script::Module SyntheticModel::create(int classes, unsigned seed)
+{
+	torch::manual_seed(seed);
+	torch::jit::script::Module model("SyntheticYoloV5");
+	model.register_parameter("w1", torch::randn({ 16, 3, 3, 3 }) * 0.2, false);
+	model.register_parameter("w2", torch::randn({ 32, 16, 3, 3 }) * 0.1, false);
+	model.register_parameter("w3", torch::randn({ 5 + classes, 32, 3, 3 }) * 0.1, false);
+	model.define(R"(
+def forward(self, x):
+    y = torch.relu(torch.conv2d(x, self.w1, None, [2, 2], [1, 1]))
+    y = torch.relu(torch.conv2d(y, self.w2, None, [2, 2], [1, 1]))
+    y = torch.sigmoid(torch.conv2d(y, self.w3, None, [2, 2], [1, 1]))
+    y = y.flatten(2).permute(0, 2, 1)
+    boxes = y[:, :, 0:4] * float(x.size(3))
+    return (torch.cat([boxes, y[:, :, 4:]], 2),)
+)");
+	model.eval();
+	return model;
+}
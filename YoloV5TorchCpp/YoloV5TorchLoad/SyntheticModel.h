@@ -0,0 +1,24 @@
+﻿#pragma once
+#ifndef SYNTHETICMODEL_H
+#define SYNTHETICMODEL_H
+
+#include <torch/script.h>
+
+/**
+ * SyntheticModel (small random TorchScript model with the YoloV5 output layout)
+ * Three stride 2 convolutions produce (batch, height / 8 * width / 8, 5 + classes),
+ * enough to load the pipeline without shipping a trained model.
+ */
+class SyntheticModel
+{
+public:
+	/**
+	 * Create the model
+	 * @param classes number of classes
+	 * @param seed seed of the random weights
+	 * @return torchscript module returning a tuple like an exported YoloV5
+	 */
+	static torch::jit::script::Module create(int classes = 80, unsigned seed = 0);
+};
+
+#endif // !SYNTHETICMODEL_H
@@ -0,0 +1,163 @@
+﻿#include "YoloV5Client.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * YoloV5ClientCheck
+ * Round trip of frames through a running YoloV5TorchServer (socket, shared memory slots and results),
+ * the exit code is 1 if any case fails
+ * usage: YoloV5ClientCheck [socketPath]
+ */
+
+static int failures = 0;
+
+static void report(const std::string& name, bool ok, const std::string& detail)
+{
+	std::printf("%-40s %-4s %s\n", name.c_str(), ok ? "PASS" : "FAIL", detail.c_str());
+	if (!ok)
+	{
+		failures++;
+	}
+}
+
+// gradient frame with a padded stride, so that the rows are not contiguous
+static std::vector<uint8_t> syntheticFrame(int width, int height, int pixelBytes, int stride)
+{
+	std::vector<uint8_t> frame((size_t)stride * height, 0);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width * pixelBytes; x++)
+		{
+			frame[(size_t)y * stride + x] = (uint8_t)((x * 7 + y * 3) & 0xFF);
+		}
+	}
+	return frame;
+}
+
+// detections of the server stay in the frame and in the value ranges of YoloResult
+static std::string checkResults(const std::vector<YoloResult>& results, int width, int height, int resultCapacity)
+{
+	if (results.size() > resultCapacity)
+	{
+		return "more results than the slot capacity";
+	}
+	for (int i = 0; i < results.size(); i++)
+	{
+		const YoloResult& r = results[i];
+		if (r.ClassIndex < 0 || r.ClassIndex >= 80 || !(r.Confidence > 0 && r.Confidence <= 1) ||
+			r.X < 0 || r.Y < 0 || r.Width < 0 || r.Height < 0 || r.X > width || r.Y > height)
+		{
+			return "invalid result " + std::to_string(i);
+		}
+	}
+	return "";
+}
+
+static bool sameResults(const std::vector<YoloResult>& a, const std::vector<YoloResult>& b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < a.size(); i++)
+	{
+		if (a[i].ClassIndex != b[i].ClassIndex || a[i].Confidence != b[i].Confidence ||
+			a[i].X != b[i].X || a[i].Y != b[i].Y || a[i].Width != b[i].Width || a[i].Height != b[i].Height)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string socketPath = argc > 1 ? argv[1] : "/tmp/yolov5.sock";
+	const int slotCount = 4, resultCapacity = 1000, width = 320, height = 240;
+
+	try
+	{
+		YoloV5Client client(socketPath, slotCount, width * height * 4, resultCapacity);
+
+		// copied into a slot by prediction
+		const char* formatNames[] = { "bgr", "rgb", "bgra", "gray" };
+		int pixelBytes[] = { 3, 3, 4, 1 };
+		std::vector<YoloResult> reference;
+		for (int f = 0; f < 4; f++)
+		{
+			int stride = width * pixelBytes[f] + 16;
+			std::vector<uint8_t> frame = syntheticFrame(width, height, pixelBytes[f], stride);
+			ImageDescriptor image;
+			image.data = frame.data();
+			image.width = width;
+			image.height = height;
+			image.stride = stride;
+			image.format = (PixelFormat)f;
+			std::vector<YoloResult> results = client.prediction(image);
+			std::string error = checkResults(results, width, height, resultCapacity);
+			report(std::string("prediction ") + formatNames[f], error.empty(),
+				error.empty() ? std::to_string(results.size()) + " result(s)" : error);
+			if (f == 0)
+			{
+				reference = results;
+			}
+		}
+
+		// every slot in flight at once, written in place, answered in any order
+		std::vector<uint8_t> frame = syntheticFrame(width, height, 3, width * 3);
+		for (int i = 0; i < slotCount; i++)
+		{
+			int slot;
+			uint8_t* memory = client.acquire(slot);
+			std::memcpy(memory, frame.data(), frame.size());
+			client.submit(slot, width, height, width * 3, PixelFormat::BGR);
+		}
+		int same = 0;
+		for (int i = 0; i < slotCount; i++)
+		{
+			int slot;
+			same += sameResults(client.receive(slot), reference) ? 1 : 0;
+		}
+		report("pipelined slots", same == slotCount,
+			std::to_string(same) + "/" + std::to_string(slotCount) + " match the copied bgr frame");
+
+		// a frame larger than its slot is answered with an error and the slot is given back
+		int slot;
+		client.acquire(slot);
+		client.submit(slot, width * 4, height, width * 16, PixelFormat::BGRA);
+		bool rejected = false;
+		try
+		{
+			client.receive(slot);
+		}
+		catch (std::runtime_error&)
+		{
+			rejected = true;
+		}
+		std::vector<YoloResult> after = client.prediction(ImageDescriptor{ frame.data(), width, height, width * 3, PixelFormat::BGR });
+		report("oversized frame", rejected && sameResults(after, reference),
+			rejected ? "rejected, the connection stays usable" : "accepted");
+
+		// the ring of a client is capped, the server refuses it instead of allocating it
+		bool refused = false;
+		try
+		{
+			YoloV5Client huge(socketPath, 256, 1 << 28, resultCapacity);
+		}
+		catch (std::runtime_error&)
+		{
+			refused = true;
+		}
+		report("oversized ring", refused, refused ? "refused" : "accepted");
+	}
+	catch (std::exception& ex)
+	{
+		report("connection", false, ex.what());
+	}
+
+	std::printf("%d case(s) failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+﻿#include "YoloV5Pool.h"
+#include "YoloV5Ipc.h"
+#include "YoloResult.h"
+#include "SyntheticModel.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * YoloV5TorchServer
+ * Owns a YoloV5Pool and serves the predictions of local processes (see YoloV5Ipc.h)
+ * usage: YoloV5TorchServer torchScriptPath [socketPath] [replicas] [threadsPerReplica] [height] [width] [confThres] [iouThres]
+ * torchScriptPath "synthetic" serves the random model of YoloV5TorchLoad, enough to check a client without a trained model
+ */
+
+// listening socket, closed to stop the server
+static int listenFd = -1;
+
+// connection of a client, the shared memory is released with the last queued prediction
+struct Connection
+{
+	int fd;
+	std::string name;
+	void* ring;
+	int64_t size;
+	std::mutex writeMutex;
+
+	~Connection()
+	{
+		if (ring != nullptr)
+		{
+			munmap(ring, size);
+			shm_unlink(name.c_str());
+		}
+		close(fd);
+	}
+};
+
+static void onSignal(int)
+{
+	if (listenFd >= 0)
+	{
+		shutdown(listenFd, SHUT_RDWR);
+	}
+}
+
+// predict the frame of a slot and answer the client
+static void predictSlot(YoloV5& yolov5, const std::shared_ptr<Connection>& connection, const IpcRequest& request)
+{
+	IpcRingHeader* header = (IpcRingHeader*)connection->ring;
+	IpcResponse response;
+	response.slot = request.slot;
+	response.status = 0;
+	response.resultCount = 0;
+	try
+	{
+		ImageDescriptor image;
+		image.data = ipcFrame(connection->ring, request.slot);
+		image.width = request.width;
+		image.height = request.height;
+		image.stride = request.stride;
+		image.format = (PixelFormat)request.format;
+		torch::Tensor result = yolov5.prediction(image)[0].toType(torch::kFloat).contiguous();
+		auto rows = result.accessor<float, 2>();
+		YoloResult* results = ipcResults(connection->ring, request.slot);
+		int count = std::min((int)result.size(0), header->resultCapacity);
+		for (int i = 0; i < count; i++)
+		{
+			results[i].ClassIndex = (int)rows[i][5];
+			results[i].Confidence = rows[i][4];
+			results[i].X = (int)rows[i][0];
+			results[i].Y = (int)rows[i][1];
+			results[i].Width = (int)rows[i][2] - (int)rows[i][0];
+			results[i].Height = (int)rows[i][3] - (int)rows[i][1];
+		}
+		response.resultCount = count;
+	}
+	catch (std::exception& ex)
+	{
+		std::cout << "YoloV5TorchServer Exception: " << ex.what() << std::endl;
+		response.status = 1;
+	}
+	std::lock_guard<std::mutex> lock(connection->writeMutex);
+	ipcWriteAll(connection->fd, &response, sizeof(response));
+}
+
+// thread serving a client
+struct Client
+{
+	std::thread thread;
+	// expired once the connection and its queued predictions are released
+	std::weak_ptr<Connection> connection;
+	std::shared_ptr<std::atomic<bool>> done;
+};
+
+// handshake and requests of a client, returns when the socket is closed or shut down
+static void serve(YoloV5Pool& pool, std::shared_ptr<Connection> connection, int id)
+{
+	int fd = connection->fd;
+	IpcHello hello;
+	if (!ipcReadAll(fd, &hello, sizeof(hello)))
+	{
+		return;
+	}
+	IpcWelcome welcome;
+	std::memset(&welcome, 0, sizeof(welcome));
+	welcome.status = 1;
+	// each field is bounded first so that the ring size cannot overflow, then the ring as a whole
+	if (hello.slotCount > 0 && hello.slotCount <= 256 && hello.frameCapacity > 0 && hello.frameCapacity <= (1 << 28) &&
+		hello.resultCapacity > 0 && hello.resultCapacity <= 100000 &&
+		ipcRingSize(hello.slotCount, hello.frameCapacity, hello.resultCapacity) <= YOLOV5_IPC_MAX_RING_SIZE)
+	{
+		connection->name = "/yolov5-" + std::to_string(getpid()) + "-" + std::to_string(id);
+		connection->size = ipcRingSize(hello.slotCount, hello.frameCapacity, hello.resultCapacity);
+		int shm = shm_open(connection->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (shm >= 0 && ftruncate(shm, connection->size) == 0)
+		{
+			void* ring = mmap(nullptr, connection->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+			if (ring != MAP_FAILED)
+			{
+				connection->ring = ring;
+				IpcRingHeader* header = (IpcRingHeader*)ring;
+				header->magic = YOLOV5_IPC_MAGIC;
+				header->slotCount = hello.slotCount;
+				header->frameCapacity = hello.frameCapacity;
+				header->resultCapacity = hello.resultCapacity;
+				header->slotSize = ipcSlotSize(hello.frameCapacity, hello.resultCapacity);
+				welcome.status = 0;
+				std::strncpy(welcome.name, connection->name.c_str(), YOLOV5_IPC_NAME_LENGTH - 1);
+				welcome.size = connection->size;
+			}
+		}
+		if (shm >= 0)
+		{
+			close(shm);
+			if (connection->ring == nullptr)
+			{
+				shm_unlink(connection->name.c_str());
+			}
+		}
+	}
+	if (!ipcWriteAll(fd, &welcome, sizeof(welcome)) || welcome.status != 0)
+	{
+		return;
+	}
+
+	IpcRingHeader* header = (IpcRingHeader*)connection->ring;
+	IpcRequest request;
+	while (ipcReadAll(fd, &request, sizeof(request)))
+	{
+		int rows = request.format == (int32_t)PixelFormat::NV12 ? request.height * 3 / 2 : request.height;
+		if (request.slot < 0 || request.slot >= header->slotCount || request.stride <= 0 || rows <= 0 ||
+			(int64_t)request.stride * rows > header->frameCapacity)
+		{
+			IpcResponse response;
+			response.slot = request.slot < 0 || request.slot >= header->slotCount ? -1 : request.slot;
+			response.status = 1;
+			response.resultCount = 0;
+			std::lock_guard<std::mutex> lock(connection->writeMutex);
+			ipcWriteAll(fd, &response, sizeof(response));
+			continue;
+		}
+		pool.submit([connection, request](YoloV5& yolov5) { predictSlot(yolov5, connection, request); });
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "usage: YoloV5TorchServer torchScriptPath [socketPath] [replicas] [threadsPerReplica] "
+			"[height] [width] [confThres] [iouThres]" << std::endl;
+		return 1;
+	}
+	std::string socketPath = argc > 2 ? argv[2] : "/tmp/yolov5.sock";
+	int replicas = argc > 3 ? std::atoi(argv[3]) : 0;
+	int threadsPerReplica = argc > 4 ? std::atoi(argv[4]) : 4;
+	int height = argc > 5 ? std::atoi(argv[5]) : 640;
+	int width = argc > 6 ? std::atoi(argv[6]) : 640;
+	float confThres = argc > 7 ? std::atof(argv[7]) : 0.25f;
+	float iouThres = argc > 8 ? std::atof(argv[8]) : 0.45f;
+
+	std::string modelPath = argv[1];
+	torch::jit::script::Module model = modelPath == "synthetic" ? SyntheticModel::create() : torch::jit::load(modelPath);
+	std::unique_ptr<YoloV5Pool> pool(new YoloV5Pool(model, replicas, threadsPerReplica, true, height, width, confThres, iouThres));
+	std::cout << "YoloV5TorchServer: " << pool->getReplicas() << " replicas x " << pool->getThreadsPerReplica()
+		<< " threads on " << socketPath << std::endl;
+
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+	unlink(socketPath.c_str());
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0 || bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 64) != 0)
+	{
+		std::cout << "YoloV5TorchServer: cannot listen on " << socketPath << std::endl;
+		return 1;
+	}
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	std::list<Client> clients;
+	int id = 0;
+	while (true)
+	{
+		int fd = accept(listenFd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		// join the threads of the clients that left
+		for (std::list<Client>::iterator it = clients.begin(); it != clients.end();)
+		{
+			if (*it->done)
+			{
+				it->thread.join();
+				it = clients.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+
+		std::shared_ptr<Connection> connection(new Connection());
+		connection->fd = fd;
+		connection->ring = nullptr;
+		connection->size = 0;
+		clients.emplace_back();
+		Client& client = clients.back();
+		client.connection = connection;
+		client.done.reset(new std::atomic<bool>(false));
+		std::shared_ptr<std::atomic<bool>> done = client.done;
+		YoloV5Pool* served = pool.get();
+		int clientId = id++;
+		client.thread = std::thread([served, connection, clientId, done]()
+			{
+				serve(*served, connection, clientId);
+				*done = true;
+			});
+	}
+
+	// no new client, then the sockets of the clients are shut down so that their threads leave
+	close(listenFd);
+	unlink(socketPath.c_str());
+	for (std::list<Client>::iterator it = clients.begin(); it != clients.end(); it++)
+	{
+		std::shared_ptr<Connection> connection = it->connection.lock();
+		if (connection)
+		{
+			shutdown(connection->fd, SHUT_RDWR);
+		}
+	}
+	for (std::list<Client>::iterator it = clients.begin(); it != clients.end(); it++)
+	{
+		it->thread.join();
+	}
+	// the pool finishes the queued predictions, the last one of a connection unmaps and unlinks its shared memory
+	pool.reset();
+	std::cout << "YoloV5TorchServer: stopped" << std::endl;
+	return 0;
+}
@@ -0,0 +1,170 @@
+﻿#include "YoloV5Client.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+YoloV5Client::YoloV5Client(const std::string& socketPath, int slotCount, int frameCapacity, int resultCapacity)
+{
+	this->fd = -1;
+	this->ring = nullptr;
+	this->ringSize = 0;
+	this->slotCount = slotCount;
+	this->frameCapacity = frameCapacity;
+
+	sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		throw std::invalid_argument("socket path too long: " + socketPath);
+	}
+	std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		close();
+		throw std::runtime_error("cannot connect to " + socketPath);
+	}
+
+	IpcHello hello;
+	hello.slotCount = slotCount;
+	hello.frameCapacity = frameCapacity;
+	hello.resultCapacity = resultCapacity;
+	IpcWelcome welcome;
+	if (!ipcWriteAll(fd, &hello, sizeof(hello)) || !ipcReadAll(fd, &welcome, sizeof(welcome)) || welcome.status != 0)
+	{
+		close();
+		throw std::runtime_error("server refused the connection");
+	}
+	welcome.name[YOLOV5_IPC_NAME_LENGTH - 1] = 0;
+
+	int shm = shm_open(welcome.name, O_RDWR, 0);
+	if (shm < 0)
+	{
+		close();
+		throw std::runtime_error(std::string("cannot open shared memory ") + welcome.name);
+	}
+	ring = mmap(nullptr, welcome.size, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+	::close(shm);
+	if (ring == MAP_FAILED || ((IpcRingHeader*)ring)->magic != YOLOV5_IPC_MAGIC)
+	{
+		ring = ring == MAP_FAILED ? nullptr : ring;
+		ringSize = welcome.size;
+		close();
+		throw std::runtime_error(std::string("invalid shared memory ") + welcome.name);
+	}
+	ringSize = welcome.size;
+	freeSlots.assign(slotCount, true);
+}
+
+YoloV5Client::~YoloV5Client()
+{
+	close();
+}
+
+void YoloV5Client::close()
+{
+	if (ring != nullptr)
+	{
+		munmap(ring, ringSize);
+		ring = nullptr;
+	}
+	if (fd >= 0)
+	{
+		::close(fd);
+		fd = -1;
+	}
+}
+
+int YoloV5Client::getSlotCount()
+{
+	return slotCount;
+}
+
+int YoloV5Client::getFrameCapacity()
+{
+	return frameCapacity;
+}
+
+uint8_t* YoloV5Client::acquire(int& slot)
+{
+	for (int i = 0; i < freeSlots.size(); i++)
+	{
+		if (freeSlots[i])
+		{
+			freeSlots[i] = false;
+			slot = i;
+			return ipcFrame(ring, i);
+		}
+	}
+	throw std::runtime_error("no free slot, receive the finished frames first");
+}
+
+void YoloV5Client::submit(int slot, int width, int height, int stride, PixelFormat format)
+{
+	IpcRequest request;
+	request.slot = slot;
+	request.width = width;
+	request.height = height;
+	request.stride = stride;
+	request.format = (int32_t)format;
+	if (!ipcWriteAll(fd, &request, sizeof(request)))
+	{
+		throw std::runtime_error("connection to the server lost");
+	}
+}
+
+std::vector<YoloResult> YoloV5Client::receive(int& slot)
+{
+	IpcResponse response;
+	if (!ipcReadAll(fd, &response, sizeof(response)))
+	{
+		throw std::runtime_error("connection to the server lost");
+	}
+	slot = response.slot;
+	if (slot < 0 || slot >= freeSlots.size())
+	{
+		// the server could not tell which slot was meant, the slots in flight stay in flight
+		throw std::runtime_error("request rejected by the server: invalid slot");
+	}
+	freeSlots[slot] = true;
+	if (response.status != 0)
+	{
+		throw std::runtime_error("prediction failed on the server");
+	}
+	YoloResult* results = ipcResults(ring, slot);
+	return std::vector<YoloResult>(results, results + response.resultCount);
+}
+
+std::vector<YoloResult> YoloV5Client::prediction(const ImageDescriptor& image)
+{
+	for (int i = 0; i < freeSlots.size(); i++)
+	{
+		if (!freeSlots[i])
+		{
+			throw std::runtime_error("prediction cannot be mixed with frames in flight");
+		}
+	}
+
+	int pixelBytes = image.format == PixelFormat::BGRA ? 4 :
+		(image.format == PixelFormat::GRAY || image.format == PixelFormat::NV12) ? 1 : 3;
+	int rows = image.format == PixelFormat::NV12 ? image.height * 3 / 2 : image.height;
+	int rowBytes = image.width * pixelBytes;
+	if ((int64_t)rowBytes * rows > frameCapacity)
+	{
+		throw std::invalid_argument("frame larger than the slot capacity");
+	}
+
+	int slot;
+	uint8_t* frame = acquire(slot);
+	for (int r = 0; r < rows; r++)
+	{
+		std::memcpy(frame + (int64_t)r * rowBytes, image.data + (int64_t)r * image.stride, rowBytes);
+	}
+	submit(slot, image.width, image.height, rowBytes, image.format);
+	return receive(slot);
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+#ifndef YOLOV5CLIENT_H
+#define YOLOV5CLIENT_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "YoloV5Ipc.h"
+#include "ImageDescriptor.h"
+
+/**
+ * YoloV5Client Class (client of YoloV5TorchServer)
+ * Frames are placed in a shared memory slot and only the slot index travels over the socket.
+ * Up to getSlotCount() frames can be in flight; a client object is not thread safe.
+ */
+class YoloV5Client
+{
+public:
+	/**
+	 * Constructor, connects to the server (the ring must fit in YOLOV5_IPC_MAX_RING_SIZE)
+	 * @param socketPath unix domain socket of the server
+	 * @param slotCount number of slots in the ring
+	 * @param frameCapacity maximum bytes of a frame
+	 * @param resultCapacity maximum results of a frame
+	 */
+	YoloV5Client(const std::string& socketPath = "/tmp/yolov5.sock", int slotCount = 4,
+		int frameCapacity = 1920 * 1080 * 4, int resultCapacity = 1000);
+
+	// Destructor, disconnects from the server
+	~YoloV5Client();
+
+	YoloV5Client(const YoloV5Client&) = delete;
+	YoloV5Client& operator=(const YoloV5Client&) = delete;
+
+	/**
+	 * prediction (copies the frame into a free slot and waits for the results)
+	 * @param image prediction image descriptor
+	 * @return prediction result
+	 */
+	std::vector<YoloResult> prediction(const ImageDescriptor& image);
+
+	/**
+	 * Get the frame memory of a free slot, write the frame there to skip the copy of prediction
+	 * @param slot index of the slot
+	 * @return frame memory of getFrameCapacity() bytes
+	 */
+	uint8_t* acquire(int& slot);
+
+	/**
+	 * Send the frame written to an acquired slot
+	 * @param slot index of the slot
+	 * @param width image width in pixels
+	 * @param height image height in pixels
+	 * @param stride bytes between the starts of two rows
+	 * @param format pixel format
+	 */
+	void submit(int slot, int width, int height, int stride, PixelFormat format);
+
+	/**
+	 * Wait for the next finished frame, its slot becomes free
+	 * @param slot index of the slot of the finished frame
+	 * @return prediction result
+	 */
+	std::vector<YoloResult> receive(int& slot);
+
+	// get number of slots in the ring
+	int getSlotCount();
+
+	// get maximum bytes of a frame
+	int getFrameCapacity();
+
+private:
+	// socket of the server
+	int fd;
+
+	// mapped shared memory
+	void* ring;
+	int64_t ringSize;
+
+	int slotCount;
+	int frameCapacity;
+
+	// slots not owned by the server
+	std::vector<bool> freeSlots;
+
+	// close the connection
+	void close();
+};
+
+#endif // !YOLOV5CLIENT_H
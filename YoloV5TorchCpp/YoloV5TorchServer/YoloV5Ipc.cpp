@@ -0,0 +1,45 @@
+﻿#include "YoloV5Ipc.h"
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool ipcWriteAll(int fd, const void* buffer, size_t length)
+{
+	const char* p = (const char*)buffer;
+	while (length > 0)
+	{
+		ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		length -= n;
+	}
+	return true;
+}
+
+bool ipcReadAll(int fd, void* buffer, size_t length)
+{
+	char* p = (char*)buffer;
+	while (length > 0)
+	{
+		ssize_t n = recv(fd, p, length, 0);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		length -= n;
+	}
+	return true;
+}
@@ -0,0 +1,142 @@
+﻿#pragma once
+#ifndef YOLOV5IPC_H
+#define YOLOV5IPC_H
+
+#include <cstdint>
+#include <cstddef>
+#include "YoloResult.h"
+
+/**
+ * Protocol between YoloV5TorchServer and YoloV5Client
+ * Control messages go over a unix domain socket, frames and results are exchanged
+ * through a shared memory ring of slots created by the server for each client.
+ * The socket messages order the accesses, a slot belongs to the client until its
+ * request is sent and to the server until its response is sent.
+ */
+
+// first bytes of the shared memory
+const uint32_t YOLOV5_IPC_MAGIC = 0x59563549;
+
+// maximum length of a shared memory name
+const int YOLOV5_IPC_NAME_LENGTH = 64;
+
+// maximum bytes of the shared memory of a client, larger rings are refused
+const int64_t YOLOV5_IPC_MAX_RING_SIZE = (int64_t)1 << 30;
+
+/**
+ * First message of a client
+ */
+struct IpcHello
+{
+	// number of slots in the ring
+	int32_t slotCount;
+	// bytes of a frame in a slot
+	int32_t frameCapacity;
+	// results of a slot
+	int32_t resultCapacity;
+};
+
+/**
+ * Answer to IpcHello
+ */
+struct IpcWelcome
+{
+	// 0 on success
+	int32_t status;
+	// shared memory name for shm_open
+	char name[YOLOV5_IPC_NAME_LENGTH];
+	// bytes of the shared memory
+	int64_t size;
+};
+
+/**
+ * Frame written to a slot (client to server)
+ */
+struct IpcRequest
+{
+	int32_t slot;
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	// PixelFormat
+	int32_t format;
+};
+
+/**
+ * Results written to a slot (server to client)
+ */
+struct IpcResponse
+{
+	// -1 when the request named no valid slot
+	int32_t slot;
+	// 0 on success
+	int32_t status;
+	// results written to the slot
+	int32_t resultCount;
+};
+
+/**
+ * Header of the shared memory
+ */
+struct IpcRingHeader
+{
+	uint32_t magic;
+	int32_t slotCount;
+	int32_t frameCapacity;
+	int32_t resultCapacity;
+	// bytes between the starts of two slots
+	int64_t slotSize;
+};
+
+/**
+ * Bytes of a slot, the frame followed by the results
+ * @param frameCapacity bytes of a frame
+ * @param resultCapacity results of a slot
+ * @return bytes of a slot (multiple of 64)
+ */
+inline int64_t ipcSlotSize(int32_t frameCapacity, int32_t resultCapacity)
+{
+	int64_t frame = ((int64_t)frameCapacity + 63) / 64 * 64;
+	int64_t results = ((int64_t)resultCapacity * sizeof(YoloResult) + 63) / 64 * 64;
+	return frame + results;
+}
+
+/**
+ * Bytes of the shared memory
+ */
+inline int64_t ipcRingSize(int32_t slotCount, int32_t frameCapacity, int32_t resultCapacity)
+{
+	return 64 + slotCount * ipcSlotSize(frameCapacity, resultCapacity);
+}
+
+/**
+ * Frame of a slot
+ */
+inline uint8_t* ipcFrame(void* ring, int32_t slot)
+{
+	IpcRingHeader* header = (IpcRingHeader*)ring;
+	return (uint8_t*)ring + 64 + slot * header->slotSize;
+}
+
+/**
+ * Results of a slot
+ */
+inline YoloResult* ipcResults(void* ring, int32_t slot)
+{
+	IpcRingHeader* header = (IpcRingHeader*)ring;
+	return (YoloResult*)(ipcFrame(ring, slot) + ((int64_t)header->frameCapacity + 63) / 64 * 64);
+}
+
+/**
+ * Write a whole buffer to a socket
+ * @return false on failure
+ */
+bool ipcWriteAll(int fd, const void* buffer, size_t length);
+
+/**
+ * Read a whole buffer from a socket
+ * @return false on failure or end of stream
+ */
+bool ipcReadAll(int fd, void* buffer, size_t length);
+
+#endif // !YOLOV5IPC_H